@@ -0,0 +1,93 @@
+#ifndef BASIC_POLLER_H
+#define BASIC_POLLER_H
+
+#include "io_def.h"
+#include "poller.h"
+
+#include <concepts>
+#include <utility>
+
+namespace coxnet {
+  // a handler receives a stream either through on_data(Socket*, const char*, size_t) or, consuming,
+  // through size_t on_read(Socket*, const char*, size_t). on_connection(Socket*) and
+  // on_close(Socket*, int) are optional
+  template <typename Handler>
+  concept StreamHandler =
+    requires(Handler& handler, Socket* conn, const char* data, size_t size) { handler.on_data(conn, data, size); } ||
+    requires(Handler& handler, Socket* conn, const char* data, size_t size) {
+      { handler.on_read(conn, data, size) } -> std::convertible_to<size_t>;
+    };
+
+  // Poller with its callbacks bound at compile time: the read, accept and close paths are instantiated
+  // for the handler, so a callback is a direct call into it that the compiler can inline, nothing goes
+  // through a std::function. The std::function callbacks of Poller are the fallback when the handler
+  // lacks a member
+  template <StreamHandler Handler>
+  class BasicPoller : public Poller {
+  public:
+    template <typename... Args>
+    explicit BasicPoller(Args&&... args) : handler_(std::forward<Args>(args)...) {}
+
+    BasicPoller(const BasicPoller&) = delete;
+    BasicPoller& operator=(const BasicPoller&) = delete;
+
+    Handler& handler() { return handler_; }
+
+    void poll(int timeout_ms = 0) override { Poller::_poll(timeout_ms, _handler_callbacks()); }
+    void shut() override { Poller::_shut(_handler_callbacks()); }
+
+    using Poller::listen;
+    using Poller::connect;
+
+    bool listen(const char address[], const uint16_t port, ProtocolStack stack) {
+      return Poller::listen(address, port, stack, nullptr, nullptr, nullptr);
+    }
+
+    Socket* connect(const char address[], const uint16_t port) { return Poller::connect(address, port, nullptr, nullptr); }
+  private:
+    static constexpr bool has_on_read = requires(Handler& handler, Socket* conn, const char* data, size_t size) {
+      handler.on_read(conn, data, size);
+    };
+    static constexpr bool has_on_data = requires(Handler& handler, Socket* conn, const char* data, size_t size) {
+      handler.on_data(conn, data, size);
+    };
+    static constexpr bool has_on_connection = requires(Handler& handler, Socket* conn) { handler.on_connection(conn); };
+    static constexpr bool has_on_close      = requires(Handler& handler, Socket* conn, int err) { handler.on_close(conn, err); };
+
+    struct HandlerCallbacks {
+      Handler*          handler;
+      FunctionCallbacks fallback;
+
+      bool consumes_reads() const {
+        if constexpr (has_on_read) { return true; }
+        else { return fallback.consumes_reads(); }
+      }
+
+      size_t on_read(Socket* conn, const char* data, size_t size) const {
+        if constexpr (has_on_read) { return handler->on_read(conn, data, size); }
+        else { return fallback.on_read(conn, data, size); }
+      }
+
+      void on_data(Socket* conn, const char* data, size_t size) const {
+        if constexpr (has_on_data) { handler->on_data(conn, data, size); }
+        else { fallback.on_data(conn, data, size); }
+      }
+
+      void on_connection(Socket* conn) const {
+        if constexpr (has_on_connection) { handler->on_connection(conn); }
+        else { fallback.on_connection(conn); }
+      }
+
+      void on_close(Socket* conn, int err_code) const {
+        if constexpr (has_on_close) { handler->on_close(conn, err_code); }
+        else { fallback.on_close(conn, err_code); }
+      }
+    };
+
+    HandlerCallbacks _handler_callbacks() { return HandlerCallbacks{ &handler_, _function_callbacks() }; }
+
+    Handler handler_;
+  };
+} // namespace coxnet
+
+#endif // BASIC_POLLER_H
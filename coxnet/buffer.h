@@ -2,15 +2,26 @@
 #define BUFFER_H
 
 #include "io_def.h"
+#include "pool.h"
 
+#include <algorithm>
 #include <cassert>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace coxnet {
   struct SimpleBuffer {
     friend class Poller;
-    explicit SimpleBuffer(size_t initial_capacity = 8192)
-    : size_(initial_capacity), begin_(0), end_(0), seek_index_(0) {
-      data_ = new char[size_];
+    // with a pool the initial storage is one of its blocks when the capacity matches the block size
+    explicit SimpleBuffer(size_t initial_capacity = 8192, SlabPool* pool = nullptr)
+    : size_(initial_capacity), begin_(0), end_(0), seek_index_(0), initial_size_(initial_capacity) {
+      if (pool != nullptr && pool->block_size() == initial_capacity) {
+        pool_ = pool;
+      }
+      data_ = _allocate(size_);
     }
 
     SimpleBuffer(const SimpleBuffer&) = delete;
@@ -18,7 +29,8 @@ namespace coxnet {
 
     SimpleBuffer(SimpleBuffer&& other) noexcept
     : data_(other.data_), begin_(other.begin_), end_(other.end_),
-      seek_index_(other.seek_index_), size_(other.size_) {
+      seek_index_(other.seek_index_), size_(other.size_), initial_size_(other.initial_size_), pool_(other.pool_) {
+      other.pool_       = nullptr;
       other.data_       = nullptr;
       other.size_       = 0;
       other.begin_      = 0;
@@ -28,13 +40,16 @@ namespace coxnet {
 
     SimpleBuffer& operator=(SimpleBuffer&& other) noexcept {
       if (this != &other) {
-        delete[] data_;
-        data_       = other.data_;
-        begin_      = other.begin_;
-        end_        = other.end_;
-        seek_index_ = other.seek_index_;
-        size_       = other.size_;
+        _free_data();
+        data_         = other.data_;
+        begin_        = other.begin_;
+        end_          = other.end_;
+        seek_index_   = other.seek_index_;
+        size_         = other.size_;
+        initial_size_ = other.initial_size_;
+        pool_         = other.pool_;
 
+        other.pool_       = nullptr;
         other.data_       = nullptr;
         other.size_       = 0;
         other.begin_      = 0;
@@ -44,7 +59,7 @@ namespace coxnet {
       return *this;
     }
 
-    ~SimpleBuffer()                     { delete[] data_; }
+    ~SimpleBuffer()                     { _free_data(); }
     void clear()                        { begin_ = end_ = seek_index_ = 0; }
 
     size_t writable_size()              { return size_ - end_; }
@@ -54,6 +69,15 @@ namespace coxnet {
     
     char* take_data()                   { return &data_[begin_]; }
     char* take_data_from_seek()         { return &data_[seek_index_]; }
+    char* writable_data()               { return &data_[end_]; }
+
+    // drop size bytes from the front, what is left keeps its position until more space is needed
+    void consume(size_t size) {
+      assert(begin_ + size <= end_);
+      begin_ += size;
+      if (seek_index_ < begin_) { seek_index_ = begin_; }
+      if (begin_ == end_) { clear(); }
+    }
     void add_written_from_external_write(const size_t size_written) {
       assert(end_ + size_written <= size_);
       end_ += size_written;
@@ -70,35 +94,409 @@ namespace coxnet {
       if (seek_index_ < begin_) { seek_index_ = begin_; }
     }
 
-    void write(const char* data, size_t size_written) {
-      ensure_writable_size(size_written);
+    // false when the data would not fit into max_capacity
+    bool write(const char* data, size_t size_written, size_t max_capacity = max_read_buff_capacity) {
+      if (!ensure_writable_size(size_written, max_capacity)) { return false; }
+
       memcpy(&data_[end_], data, size_written);
       end_ += size_written;
+      return true;
     }
 
-    void ensure_writable_size(size_t required_size) {
+    // the consumed front is reclaimed first, the buffer only grows (doubling, up to max_capacity)
+    // when the unconsumed bytes plus required do not fit at all. False when they never would
+    bool ensure_writable_size(size_t required_size, size_t max_capacity = max_read_buff_capacity) {
       if (writable_size() >= required_size) {
-          return;
+        return true;
       }
 
-      size_t  new_size  = size_ + required_size * 2;
-      char*   temp      = new char[new_size];
-      memcpy(temp, data_ + begin_, end_);
+      const size_t used = end_ - begin_;
+      if (size_ - used >= required_size) {
+        memmove(data_, data_ + begin_, used);
+        _rebase(data_);
+        return true;
+      }
+
+      if (used + required_size > max_capacity) { return false; }
 
-      char* original  = data_;
-      data_           = temp;
-      size_           = new_size;
-      delete[] original;
+      size_t new_size = size_ * 2;
+      if (new_size < used + required_size) { new_size = used + required_size; }
+      if (new_size > max_capacity) { new_size = max_capacity; }
+
+      char* temp = _allocate(new_size);
+      memcpy(temp, data_ + begin_, used);
+      _free_data();
+      size_ = new_size;
+      _rebase(temp);
+      return true;
     }
+
+    // drop a drained buffer that grew past limit back to its initial (pooled) storage
+    void shrink_if_idle(size_t limit = read_buff_shrink_size) {
+      if (limit == 0 || end_ != begin_ || size_ <= limit || size_ <= initial_size_) { return; }
+
+      _free_data();
+      size_ = initial_size_;
+      data_ = _allocate(size_);
+      clear();
+    }
+
+    size_t capacity() const { return size_; }
 #ifdef _WIN32
     friend void WINAPI IOCompletionCallBack(DWORD, DWORD, LPOVERLAPPED);
 #endif // _WIN32
   private:
-    char* data_         = nullptr;
-    size_t begin_       = 0;
-    size_t end_         = 0;
-    size_t seek_index_  = 0;
-    size_t size_        = 0;
+    // a grown buffer is heap allocated, only storage of the initial size comes from the pool
+    char* _allocate(size_t size) {
+      if (pool_ != nullptr && size == initial_size_) { return static_cast<char*>(pool_->acquire()); }
+      return new char[size];
+    }
+
+    void _free_data() {
+      if (data_ == nullptr) { return; }
+
+      if (pool_ != nullptr && size_ == initial_size_) {
+        pool_->release(data_);
+      } else {
+        delete[] data_;
+      }
+      data_ = nullptr;
+    }
+
+    void _rebase(char* data) {
+      data_         = data;
+      end_         -= begin_;
+      seek_index_  -= begin_;
+      begin_        = 0;
+    }
+  private:
+    char* data_           = nullptr;
+    size_t begin_         = 0;
+    size_t end_           = 0;
+    size_t seek_index_    = 0;
+    size_t size_          = 0;
+    size_t initial_size_  = 0;
+    SlabPool* pool_       = nullptr;
+  };
+
+  // A view into memory kept alive by owner, lets one payload be queued on many sockets without copies.
+  struct BufferSlice {
+    std::shared_ptr<const void> owner;
+    const char*                 data  = nullptr;
+    size_t                      size  = 0;
+
+    BufferSlice() = default;
+    BufferSlice(std::shared_ptr<const void> keeper, const char* ptr, size_t len)
+    : owner(std::move(keeper)), data(ptr), size(len) {}
+
+    static BufferSlice from(std::string&& str) {
+      auto holder = std::make_shared<const std::string>(std::move(str));
+      return BufferSlice(holder, holder->data(), holder->size());
+    }
+
+    static BufferSlice from(std::vector<char>&& vec) {
+      auto holder = std::make_shared<const std::vector<char>>(std::move(vec));
+      return BufferSlice(holder, holder->data(), holder->size());
+    }
+  };
+
+  // FIFO over a power-of-two ring of slots. Unlike std::deque, which allocates a node every few
+  // entries as the queue moves along, it only allocates while it grows to its peak size
+  template <typename T>
+  class RingQueue {
+  public:
+    bool    empty() const { return head_ == tail_; }
+    size_t  size() const  { return tail_ - head_; }
+
+    T&        operator[](size_t index)        { return slots_[(head_ + index) & (slots_.size() - 1)]; }
+    const T&  operator[](size_t index) const  { return slots_[(head_ + index) & (slots_.size() - 1)]; }
+    T&        front()                         { return (*this)[0]; }
+    const T&  front() const                   { return (*this)[0]; }
+    T&        back()                          { return (*this)[size() - 1]; }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+      if (size() == slots_.size()) { _grow(); }
+
+      T& slot = slots_[tail_ & (slots_.size() - 1)];
+      slot    = T(std::forward<Args>(args)...);
+      tail_++;
+      return slot;
+    }
+
+    // the slot is reset so that whatever it owned is released now, not when it is reused
+    void pop_front() {
+      slots_[head_ & (slots_.size() - 1)] = T();
+      head_++;
+    }
+
+    void clear() {
+      while (!empty()) { pop_front(); }
+      head_ = tail_ = 0;
+    }
+  private:
+    void _grow() {
+      std::vector<T> slots(std::max<size_t>(slots_.size() * 2, 8));
+      const size_t count = size();
+      for (size_t i = 0; i < count; i++) {
+        slots[i] = std::move((*this)[i]);
+      }
+
+      slots_.swap(slots);
+      head_ = 0;
+      tail_ = count;
+    }
+  private:
+    std::vector<T>  slots_;
+    size_t          head_ = 0;
+    size_t          tail_ = 0;
+  };
+
+  // Pending output of a socket as a chain of segments, flushed with one writev/sendmsg.
+  // Plain writes are copied into fixed-size chunks, owned buffers are linked without copying.
+  // Segment memory never moves, so a chunk can be appended to while its front is being sent.
+  // File ranges are queued in order with the rest and sent from the kernel with sendfile.
+  // Segments that went out with MSG_ZEROCOPY are held after they are consumed until the kernel
+  // reports that send as completed, it still reads their pages.
+  class WriteChain {
+  public:
+    // regular chunks come from pool when its block size is chunk_size
+    explicit WriteChain(size_t chunk_size = max_write_buff_size, SlabPool* pool = nullptr) : chunk_size_(chunk_size) {
+      if (pool != nullptr && pool->block_size() == chunk_size) { pool_ = pool; }
+    }
+    ~WriteChain() {
+      clear();
+      delete[] spare_chunk_;
+    }
+
+    WriteChain(const WriteChain&) = delete;
+    WriteChain& operator=(const WriteChain&) = delete;
+
+    size_t size() const   { return total_size_; }
+    bool   empty() const  { return total_size_ == 0; }
+    size_t segment_count() const { return segments_.size(); }
+
+    void write(const char* data, size_t size) {
+      while (size > 0) {
+        Segment* tail = segments_.empty() ? nullptr : &segments_.back();
+        if (tail == nullptr || tail->chunk == nullptr || tail->tail_room() == 0) {
+          tail = _add_chunk(size);
+        }
+
+        size_t n = std::min(size, tail->tail_room());
+        memcpy(const_cast<char*>(tail->data) + tail->size, data, n);
+        tail->size  += n;
+        total_size_ += n;
+        data        += n;
+        size        -= n;
+      }
+    }
+
+    void write(BufferSlice&& slice) {
+      if (slice.size == 0) { return; }
+
+      // linking costs an iovec entry, small payloads are cheaper to copy
+      if (slice.size < min_owned_segment_size) {
+        write(slice.data, slice.size);
+        return;
+      }
+
+      Segment segment;
+      segment.data  = slice.data;
+      segment.size  = slice.size;
+      segment.owner = std::move(slice.owner);
+      total_size_  += segment.size;
+      segments_.emplace_back(std::move(segment));
+    }
+
+    // size bytes of fd starting at offset, on_done gets 0 once they are sent or the error that dropped them
+    void write_file(int fd, uint64_t offset, size_t size, std::function<void(int)> on_done) {
+      Segment segment;
+      segment.file    = fd;
+      segment.offset  = offset;
+      segment.size    = size;
+      segment.on_done = std::move(on_done);
+      total_size_    += size;
+      segments_.emplace_back(std::move(segment));
+    }
+
+    bool front_is_file() const { return !segments_.empty() && segments_.front().file >= 0; }
+
+    // the next bytes to send are a file range
+    bool front_file(int& fd, uint64_t& offset, size_t& size) const {
+      if (segments_.empty() || segments_.front().file < 0) { return false; }
+
+      fd      = segments_.front().file;
+      offset  = segments_.front().offset;
+      size    = segments_.front().size;
+      return true;
+    }
+
+    // fill at most max vectors from the front of the chain up to the next file range, returns how many were filled
+    size_t fill(IoVec* vecs, size_t max) const {
+      size_t count = 0;
+      for (; count < segments_.size() && count < max && segments_[count].file < 0; count++) {
+        const Segment& segment = segments_[count];
+#ifdef _WIN32
+        vecs[count].buf     = const_cast<char*>(segment.data);
+        vecs[count].len     = static_cast<ULONG>(segment.size);
+#else
+        vecs[count].iov_base = const_cast<char*>(segment.data);
+        vecs[count].iov_len  = segment.size;
+#endif
+      }
+      return count;
+    }
+
+    // size bytes from the front went out with the zero-copy send number seq. A partly sent front
+    // segment is tagged too, the kernel reads the part that went out
+    void consume_zerocopy(size_t size, uint32_t seq) {
+      size_t marked = 0;
+      for (size_t i = 0; i < segments_.size() && marked < size; i++) {
+        segments_[i].zerocopy     = true;
+        segments_[i].zerocopy_seq = seq;
+        marked                   += segments_[i].size;
+      }
+
+      zerocopy_sends_.emplace_back(seq, size);
+      consume(size);
+    }
+
+    // the kernel is done with every zero-copy send up to last, returns the bytes they covered.
+    // TCP completes them in order
+    size_t release_zerocopy(uint32_t last) {
+      size_t bytes = 0;
+      while (!zerocopy_sends_.empty() && static_cast<int32_t>(last - zerocopy_sends_.front().first) >= 0) {
+        bytes += zerocopy_sends_.front().second;
+        zerocopy_sends_.pop_front();
+      }
+
+      while (!held_.empty() && static_cast<int32_t>(last - held_.front().zerocopy_seq) >= 0) {
+        _release(held_.front());
+        held_.pop_front();
+      }
+      return bytes;
+    }
+
+    // drop size sent bytes from the front
+    void consume(size_t size) {
+      assert(size <= total_size_);
+      total_size_ -= size;
+      while (size > 0) {
+        Segment& head = segments_.front();
+        if (size < head.size) {
+          if (head.file < 0) {
+            head.data   += size;
+          } else {
+            head.offset += size;
+          }
+          head.size -= size;
+          return;
+        }
+
+        size -= head.size;
+        std::function<void(int)> on_done = std::move(head.on_done);
+        // the rest of a partly zero-copied segment may have gone out with a plain copy after that
+        // send completed, nothing is left to wait for then
+        if (head.zerocopy && _zerocopy_pending(head.zerocopy_seq)) {
+          held_.emplace_back(std::move(head));
+        } else {
+          _release(head);
+        }
+        segments_.pop_front();
+        if (on_done != nullptr) { on_done(0); }
+      }
+    }
+
+    // drop everything, file ranges not sent yet report err
+    void fail(int err) {
+      std::vector<std::function<void(int)>> pending;
+      for (size_t i = 0; i < segments_.size(); i++) {
+        if (segments_[i].on_done != nullptr) { pending.emplace_back(std::move(segments_[i].on_done)); }
+      }
+
+      clear();
+      for (auto& on_done : pending) {
+        on_done(err);
+      }
+    }
+
+    void clear() {
+      for (size_t i = 0; i < segments_.size(); i++) {
+        _release(segments_[i]);
+      }
+      segments_.clear();
+      total_size_ = 0;
+
+      for (size_t i = 0; i < held_.size(); i++) {
+        _release(held_[i]);
+      }
+      held_.clear();
+      zerocopy_sends_.clear();
+    }
+  private:
+    struct Segment {
+      char*                       chunk     = nullptr;  // copy storage, null for owned buffers
+      size_t                      capacity  = 0;
+      const char*                 data      = nullptr;  // first unsent byte
+      size_t                      size      = 0;        // unsent bytes
+      std::shared_ptr<const void> owner;
+      int                         file      = -1;       // file range instead of memory
+      uint64_t                    offset    = 0;        // first unsent byte of the file
+      std::function<void(int)>    on_done;
+      bool                        zerocopy      = false;  // pages still read by a zero-copy send
+      uint32_t                    zerocopy_seq  = 0;      // the last such send
+
+      size_t tail_room() const { return chunk + capacity - (data + size); }
+    };
+
+    Segment* _add_chunk(size_t size_hint) {
+      Segment segment;
+      if (pool_ != nullptr && size_hint <= chunk_size_) {
+        segment.chunk     = static_cast<char*>(pool_->acquire());
+        segment.capacity  = chunk_size_;
+      } else if (spare_chunk_ != nullptr && size_hint <= chunk_size_) {
+        segment.chunk     = spare_chunk_;
+        segment.capacity  = chunk_size_;
+        spare_chunk_      = nullptr;
+      } else {
+        // one oversized chunk for a large copy instead of many small ones
+        segment.capacity  = std::max(chunk_size_, size_hint);
+        segment.chunk     = new char[segment.capacity];
+      }
+
+      segment.data = segment.chunk;
+      segments_.emplace_back(std::move(segment));
+      return &segments_.back();
+    }
+
+    // a zero-copy send is outstanding until release_zerocopy() covered it, TCP completes them in order
+    bool _zerocopy_pending(uint32_t seq) const {
+      return !zerocopy_sends_.empty() && static_cast<int32_t>(seq - zerocopy_sends_.front().first) >= 0;
+    }
+
+    // without a pool keep one regular chunk around, a busy socket would otherwise allocate on every burst
+    void _release(Segment& segment) {
+      segment.owner.reset();
+      if (segment.chunk == nullptr) { return; }
+
+      if (pool_ != nullptr && segment.capacity == chunk_size_) {
+        pool_->release(segment.chunk);
+      } else if (spare_chunk_ == nullptr && segment.capacity == chunk_size_) {
+        spare_chunk_ = segment.chunk;
+      } else {
+        delete[] segment.chunk;
+      }
+      segment.chunk = nullptr;
+    }
+  private:
+    RingQueue<Segment>  segments_;
+    RingQueue<Segment>  held_;            // consumed, released by release_zerocopy()
+    RingQueue<std::pair<uint32_t, size_t>> zerocopy_sends_;
+    size_t              total_size_   = 0;
+    size_t              chunk_size_   = 0;
+    char*               spare_chunk_  = nullptr;
+    SlabPool*           pool_         = nullptr;
   };
 } // namespace coxnet
 
@@ -0,0 +1,112 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "io_def.h"
+#include "socket.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+namespace coxnet {
+  enum class ByteOrder { kBigEndian, kLittleEndian };
+
+  struct FrameOptions {
+    size_t    header_size     = 4;  // width of the length field: 1, 2, 4 or 8 bytes
+    ByteOrder byte_order      = ByteOrder::kBigEndian;
+    size_t    max_frame_size  = default_max_frame_size;  // payload limit, larger frames close with EMSGSIZE
+  };
+
+  // a complete payload, it points into the read buffer and is only valid during the call
+  using FrameCallback = std::function<void(Socket*, const char*, size_t)>;
+
+  // [length][payload] framing, length counts the payload only.
+  // reader() plugs into IPoller::set_read_callback(): every frame that is complete in the read buffer
+  // is handed out in place, an incomplete tail stays buffered until the rest arrives.
+  // write() sends header and payload with one gather write.
+  class LengthFieldCodec {
+  public:
+    // max_frame_size is clamped to what the length field can express and what fits the read buffer
+    // together with its header
+    explicit LengthFieldCodec(FrameOptions options = {}) : options_(options) {
+      assert(options_.header_size == 1 || options_.header_size == 2 ||
+             options_.header_size == 4 || options_.header_size == 8);
+      options_.max_frame_size = static_cast<size_t>(std::min<uint64_t>({ options_.max_frame_size, _max_length(),
+                                                                        max_read_buff_capacity - options_.header_size }));
+    }
+
+    const FrameOptions& options() const { return options_; }
+
+    ReadCallback reader(FrameCallback on_frame) const {
+      return [codec = *this, on_frame = std::move(on_frame)](Socket* conn, const char* data, size_t size) {
+        return codec.decode(conn, data, size, on_frame);
+      };
+    }
+
+    // returns the bytes used by complete frames
+    size_t decode(Socket* conn, const char* data, size_t size, const FrameCallback& on_frame) const {
+      const size_t header_size  = options_.header_size;
+      size_t       used         = 0;
+      while (size - used >= header_size) {
+        const uint64_t frame_size = _read_length(data + used);
+        if (frame_size > options_.max_frame_size) {
+          conn->close_with_error(EMSGSIZE);
+          return size;
+        }
+
+        if (size - used - header_size < frame_size) { break; }
+
+        if (on_frame != nullptr) { on_frame(conn, data + used + header_size, static_cast<size_t>(frame_size)); }
+        used += header_size + static_cast<size_t>(frame_size);
+
+        // closed from the callback, the rest is never read
+        if (!conn->is_valid()) { return size; }
+      }
+
+      return used;
+    }
+
+    // -1 for a payload over max_frame_size, nothing is sent then
+    int write(Socket* conn, const char* data, size_t size) const {
+      char header[8];
+      if (size > options_.max_frame_size || !_write_length(header, size)) { return -1; }
+
+      return conn->writev({ std::string_view(header, options_.header_size), std::string_view(data, size) });
+    }
+
+    int write(Socket* conn, std::string_view payload) const { return write(conn, payload.data(), payload.size()); }
+  private:
+    uint64_t _read_length(const char* header) const {
+      auto      bytes   = reinterpret_cast<const uint8_t*>(header);
+      uint64_t  length  = 0;
+      for (size_t i = 0; i < options_.header_size; i++) {
+        const size_t index = options_.byte_order == ByteOrder::kBigEndian ? i : options_.header_size - 1 - i;
+        length = (length << 8) | bytes[index];
+      }
+      return length;
+    }
+
+    // the largest length the header can carry
+    uint64_t _max_length() const {
+      return options_.header_size >= 8 ? UINT64_MAX : (uint64_t(1) << (8 * options_.header_size)) - 1;
+    }
+
+    // false when length does not fit the header, it is never truncated
+    bool _write_length(char* header, uint64_t length) const {
+      if (length > _max_length()) { return false; }
+
+      for (size_t i = 0; i < options_.header_size; i++) {
+        const size_t index = options_.byte_order == ByteOrder::kBigEndian ? options_.header_size - 1 - i : i;
+        header[index] = static_cast<char>(length & 0xff);
+        length >>= 8;
+      }
+      return true;
+    }
+  private:
+    FrameOptions options_;
+  };
+} // namespace coxnet
+
+#endif // CODEC_H
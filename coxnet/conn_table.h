@@ -0,0 +1,108 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include "io_def.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace coxnet {
+  class Socket;
+
+  // Connections of one poller indexed by their handle. Handles are small dense integers (fds on POSIX,
+  // multiples of 4 on Windows), so lookup is a plain array index, and the connections themselves
+  // are kept packed in a second array for iteration. Insert and erase are O(1) and allocate only
+  // when the table grows past its largest handle so far.
+  // Every insert bumps the generation of its slot, a ConnId (generation << 32 | slot) therefore stops
+  // resolving once its connection is gone, even when the fd number has been reused.
+  class ConnTable {
+  public:
+    struct Entry {
+      socket_t  handle;
+      Socket*   conn;
+    };
+
+    using iterator = std::vector<Entry>::const_iterator;
+
+    ConnTable() = default;
+    ConnTable(const ConnTable&) = delete;
+    ConnTable& operator=(const ConnTable&) = delete;
+
+    Socket* find(socket_t handle) const {
+      const size_t index = _index(handle);
+      if (index >= slots_.size() || slots_[index] == npos) { return nullptr; }
+      return entries_[slots_[index]].conn;
+    }
+
+    // nullptr for a stale id
+    Socket* find(ConnId id) const {
+      const size_t    index       = static_cast<uint32_t>(id);
+      const uint32_t  generation  = static_cast<uint32_t>(id >> 32);
+      if (index >= slots_.size() || slots_[index] == npos || generations_[index] != generation) { return nullptr; }
+      return entries_[slots_[index]].conn;
+    }
+
+    // returns the id of the new entry, invalid_conn_id when the handle is already taken
+    ConnId insert(socket_t handle, Socket* conn) {
+      const size_t index = _index(handle);
+      if (index >= slots_.size()) {
+        const size_t new_size = std::max(index + 1, slots_.size() * 2);
+        slots_.resize(new_size, npos);
+        generations_.resize(new_size, 0);
+      }
+
+      if (slots_[index] != npos) { return invalid_conn_id; }
+
+      // generation 0 is never used, so no id is equal to invalid_conn_id
+      if (++generations_[index] == 0) { generations_[index] = 1; }
+
+      slots_[index] = static_cast<uint32_t>(entries_.size());
+      entries_.emplace_back(Entry{ handle, conn });
+      return (static_cast<ConnId>(generations_[index]) << 32) | static_cast<ConnId>(index);
+    }
+
+    // the last entry moves into the hole, so erasing while iterating is not allowed
+    Socket* erase(socket_t handle) {
+      const size_t index = _index(handle);
+      if (index >= slots_.size() || slots_[index] == npos) { return nullptr; }
+
+      const uint32_t  position  = slots_[index];
+      Socket*         conn      = entries_[position].conn;
+      const Entry&    last      = entries_.back();
+      entries_[position]                = last;
+      slots_[_index(last.handle)]       = position;
+      slots_[index]                     = npos;
+      entries_.pop_back();
+      return conn;
+    }
+
+    void clear() {
+      for (const Entry& entry : entries_) {
+        slots_[_index(entry.handle)] = npos;
+      }
+      entries_.clear();
+    }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    iterator begin() const { return entries_.begin(); }
+    iterator end() const { return entries_.end(); }
+  private:
+    static size_t _index(socket_t handle) {
+#ifdef _WIN32
+      return static_cast<size_t>(handle) >> 2;
+#else
+      return static_cast<size_t>(handle);
+#endif
+    }
+  private:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    std::vector<uint32_t> slots_;         // handle index -> position in entries_
+    std::vector<uint32_t> generations_;   // handle index -> generation of its last insert
+    std::vector<Entry>    entries_;
+  };
+} // namespace coxnet
+
+#endif // CONN_TABLE_H
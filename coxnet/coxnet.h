@@ -9,11 +9,19 @@
 #endif
 
 #ifdef __linux__
+#ifdef COXNET_USE_IO_URING
+#include "poller_uring.h"
+#else
 #include "poller_linux.h"
 #endif
+#endif
 
 #ifdef __APPLE__
 #include "poller_mac.h"
 #endif 
 
+#include "basic_poller.h"
+#include "poller_group.h"
+#include "codec.h"
+
 #endif
\ No newline at end of file
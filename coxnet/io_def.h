@@ -29,7 +29,9 @@
 #define _GNU_SOURCE // for accept4
 #include <sys/socket.h>
 
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef __APPLE__
@@ -38,6 +40,7 @@
 
 #ifdef __linux__
 #include <sys/epoll.h>
+#include <sys/sendfile.h>
 #endif
 
 #endif
@@ -47,6 +50,8 @@
 
 namespace coxnet {
   class Socket;
+  class UdpSocket;
+  struct Datagram;
 #ifdef _WIN32
   using socket_t = SOCKET;
   static constexpr socket_t invalid_socket = INVALID_SOCKET;
@@ -57,10 +62,43 @@ namespace coxnet {
   static constexpr int SOCKET_ERROR = -1;
 #endif // _WIN32
 
+#ifdef _WIN32
+  using IoVec = WSABUF;
+#else
+  using IoVec = iovec;
+#endif
+
+#ifdef MSG_NOSIGNAL
+  static constexpr int send_flags = MSG_NOSIGNAL; // report EPIPE instead of raising SIGPIPE
+#else
+  static constexpr int send_flags = 0;
+#endif
+
   using ConnectionCallback  = std::function<void(Socket*)>;
   using CloseCallback       = std::function<void(Socket*, int)>;
   using DataCallback        = std::function<void(Socket*, const char*, size_t)>;
+  // returns how many bytes were consumed, the rest stays buffered and is passed again with the next read
+  using ReadCallback        = std::function<size_t(Socket*, const char*, size_t)>;
   using ListenErrorCallback = std::function<void(int)>;
+  // outcome of async_connect: err is 0 once connected, otherwise the socket is released right after
+  using ConnectCallback     = std::function<void(Socket*, int)>;
+  // the socket's queued output crossed its high watermark (going up) or its low watermark (going down)
+  using WatermarkCallback   = std::function<void(Socket*, size_t)>;
+  // the kernel completed zero-copy sends covering bytes, their buffers have been released
+  using ZeroCopyCallback    = std::function<void(Socket*, size_t)>;
+  // a send_file range is done: err is 0 once all of it was sent, otherwise the error that dropped it
+  using SendFileCallback    = std::function<void(Socket*, int)>;
+  // one recvmmsg batch of a UDP socket, sources included
+  using DatagramCallback    = std::function<void(UdpSocket*, const Datagram*, size_t)>;
+  using Task                = std::function<void()>;
+
+  // identifies a connection of one poller, stays unique when fd numbers are reused (see ConnTable)
+  using ConnId              = uint64_t;
+  static constexpr ConnId invalid_conn_id = 0;
+
+  // returned by IPoller::add_timer(), ids are never reused
+  using TimerId             = uint64_t;
+  static constexpr TimerId invalid_timer_id = 0;
 
   int get_last_error() {
 #ifdef __linux__
@@ -108,22 +146,81 @@ namespace coxnet {
     return ErrorAction::kClose;
   }
 
+  inline bool set_non_blocking(socket_t handle) {
+#ifdef _WIN32
+    u_long option = 1;
+    return ioctlsocket(handle, FIONBIO, &option) == 0;
+#else
+    int option = fcntl(handle, F_GETFL, 0);
+    return fcntl(handle, F_SETFL, option | O_NONBLOCK) == 0;
+#endif
+  }
+
   // socket read and write buffer size
   static constexpr size_t max_read_buff_size    = 1024 * 4;
   static constexpr size_t max_write_buff_size   = 1024 * 4;
 
+  // a read buffer never grows past this, a peer that makes it overflow is closed with ENOBUFS
+  static constexpr size_t max_read_buff_capacity  = 64 * 1024 * 1024;
+  // a drained read buffer larger than this goes back to its initial size, 0 keeps grown buffers
+  static constexpr size_t read_buff_shrink_size   = 64 * 1024;
+
   // every io operation size
   static constexpr size_t max_size_per_write    = 1024 * 2;
   static constexpr size_t max_size_per_read     = 1024 * 2;
 
+  // one sendfile call moves at most this much, a large file does not hold up the other sockets
+  static constexpr size_t max_size_per_sendfile = 1024 * 1024;
+
+  // sendmsg batches of at least this many bytes use MSG_ZEROCOPY once a socket enabled it
+  static constexpr size_t zerocopy_threshold    = 16 * 1024;
+
+  // iovecs passed to one writev/sendmsg, owned buffers smaller than this are copied instead of linked
+  static constexpr size_t max_iov_per_write     = 64;
+  static constexpr size_t min_owned_segment_size = 256;
+
   static constexpr size_t max_epoll_event_count = 64;
 
-  enum class IPType { kInvalid, kIPv4, kIPv6 };
+  // epoll poller: bytes read from one socket per event, the rest waits its turn in the ready list
+  static constexpr size_t read_budget_per_event = 256 * 1024;
+
+  // UDP: datagrams per recvmmsg/sendmmsg, receive buffer per datagram, and the largest UDP payload
+  static constexpr size_t udp_batch_size        = 64;
+  static constexpr size_t udp_datagram_size     = 2048;
+  static constexpr size_t max_udp_payload       = 65507;
+
+  // async_connect gives up with ETIMEDOUT after this long by default, 0 waits for the kernel
+  static constexpr uint32_t default_connect_timeout_ms = 5000;
+
+  // LengthFieldCodec closes connections that announce a larger frame with EMSGSIZE
+  static constexpr size_t default_max_frame_size = 16 * 1024 * 1024;
+
+  // per-poller slab pools: buffer chunks and Socket objects are carved from slabs of this many blocks
+  static constexpr size_t pool_blocks_per_slab  = 64;
+
+  // io_uring poller: submission queue depth, and provided buffers for multishot recv (count is a power of 2)
+  static constexpr unsigned uring_queue_depth   = 1024;
+  static constexpr unsigned uring_buffer_count  = 1024;
+  static constexpr unsigned uring_buffer_size   = max_read_buff_size;
+  // shut() waits this long at most for cancelled ops to complete before it destroys the ring
+  static constexpr uint64_t uring_drain_timeout_ms = 1000;
+
+  // listen() on a unix path probes a socket file already there, one that does not answer within this long is kept
+  static constexpr int unix_probe_timeout_ms = 100;
+
+  // kUnix: a filesystem path ("/run/app.sock") or, with a leading '@', a Linux abstract name
+  enum class IPType { kInvalid, kIPv4, kIPv6, kUnix };
   inline IPType ip_address_type(const std::string& address) {
     if (address.empty()) {
       return IPType::kInvalid;
     }
 
+#ifndef _WIN32
+    if (address[0] == '/' || address[0] == '@') {
+      return IPType::kUnix;
+    }
+#endif
+
     sockaddr_in sa = { 0 };
     if (inet_pton(AF_INET, address.c_str(), &(sa.sin_addr)) == 1) {
         return IPType::kIPv4;
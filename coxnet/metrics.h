@@ -0,0 +1,251 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace coxnet {
+  // log-linear buckets: values below 4 get a bucket each, every power of two above is split into
+  // 4 sub-buckets, so a bucket is at most 25% wide and 256 of them cover all of uint64_t
+  static constexpr size_t histogram_sub_bits      = 2;
+  static constexpr size_t histogram_bucket_count  = 64 << histogram_sub_bits;
+
+  struct HistogramSnapshot {
+    std::array<uint64_t, histogram_bucket_count> buckets = {};
+    uint64_t  count = 0;
+    uint64_t  sum   = 0;
+    uint64_t  max   = 0;
+
+    static size_t bucket_of(uint64_t value) {
+      constexpr uint64_t sub_count = uint64_t(1) << histogram_sub_bits;
+      if (value < sub_count) { return static_cast<size_t>(value); }
+
+      const size_t msb    = 63 - static_cast<size_t>(std::countl_zero(value));
+      const size_t shift  = msb - histogram_sub_bits;
+      return ((shift + 1) << histogram_sub_bits) + static_cast<size_t>((value >> shift) & (sub_count - 1));
+    }
+
+    // largest value that falls into bucket index
+    static uint64_t bucket_upper(size_t index) {
+      constexpr uint64_t sub_count = uint64_t(1) << histogram_sub_bits;
+      if (index < sub_count) { return index; }
+
+      const size_t    shift = (index >> histogram_sub_bits) - 1;
+      const uint64_t  lower = (sub_count + (index & (sub_count - 1))) << shift;
+      return lower + ((uint64_t(1) << shift) - 1);
+    }
+
+    double mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count); }
+
+    // upper bound of the bucket holding the p-th percentile (0-100), exact up to the bucket width
+    uint64_t percentile(double p) const {
+      if (count == 0) { return 0; }
+
+      const uint64_t rank = static_cast<uint64_t>(static_cast<double>(count) * p / 100.0 + 0.5);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen >= rank && seen != 0) { return bucket_upper(i) < max ? bucket_upper(i) : max; }
+      }
+      return max;
+    }
+
+    HistogramSnapshot& operator+=(const HistogramSnapshot& other) {
+      for (size_t i = 0; i < buckets.size(); i++) { buckets[i] += other.buckets[i]; }
+      count += other.count;
+      sum   += other.sum;
+      max    = max > other.max ? max : other.max;
+      return *this;
+    }
+  };
+
+  struct MetricsSnapshot {
+    uint64_t  loop_iterations = 0;
+    uint64_t  events          = 0;  // I/O events returned by the kernel (epoll_wait, completions)
+    uint64_t  reads           = 0;
+    uint64_t  bytes_read      = 0;
+    uint64_t  read_again      = 0;  // reads that found the socket empty, EAGAIN
+    uint64_t  writes          = 0;
+    uint64_t  bytes_written   = 0;
+    uint64_t  write_again     = 0;  // sends refused by a full socket, EAGAIN
+    uint64_t  buffer_growths  = 0;  // read buffers that had to reallocate
+    uint64_t  accepts         = 0;
+    uint64_t  accept_failures = 0;
+    uint64_t  callbacks       = 0;  // data and read callbacks
+
+    HistogramSnapshot loop_ns;            // busy time of a poll() iteration, waiting excluded
+    HistogramSnapshot callback_ns;        // time spent in one data or read callback
+    HistogramSnapshot write_queue_bytes;  // queued output of a socket whenever it grows
+
+    MetricsSnapshot& operator+=(const MetricsSnapshot& other) {
+      loop_iterations += other.loop_iterations;
+      events          += other.events;
+      reads           += other.reads;
+      bytes_read      += other.bytes_read;
+      read_again      += other.read_again;
+      writes          += other.writes;
+      bytes_written   += other.bytes_written;
+      write_again     += other.write_again;
+      buffer_growths  += other.buffer_growths;
+      accepts         += other.accepts;
+      accept_failures += other.accept_failures;
+      callbacks       += other.callbacks;
+      loop_ns           += other.loop_ns;
+      callback_ns       += other.callback_ns;
+      write_queue_bytes += other.write_queue_bytes;
+      return *this;
+    }
+  };
+
+#ifdef COXNET_ENABLE_METRICS
+  // one writer (the poller thread) and any number of readers: plain load/store pairs instead of
+  // locked read-modify-write, readers see every value as a whole
+  class MetricCounter {
+  public:
+    void add(uint64_t n = 1) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void set(uint64_t value) { value_.store(value, std::memory_order_relaxed); }
+    uint64_t load() const { return value_.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<uint64_t> value_ = { 0 };
+  };
+
+  class Histogram {
+  public:
+    void record(uint64_t value) {
+      buckets_[HistogramSnapshot::bucket_of(value)].add();
+      count_.add();
+      sum_.add(value);
+      if (value > max_.load()) { max_.set(value); }
+    }
+
+    HistogramSnapshot snapshot() const {
+      HistogramSnapshot result;
+      for (size_t i = 0; i < buckets_.size(); i++) { result.buckets[i] = buckets_[i].load(); }
+      result.count  = count_.load();
+      result.sum    = sum_.load();
+      result.max    = max_.load();
+      return result;
+    }
+  private:
+    std::array<MetricCounter, histogram_bucket_count> buckets_;
+    MetricCounter count_;
+    MetricCounter sum_;
+    MetricCounter max_;
+  };
+
+  // per-poller counters, written by the poller thread only. snapshot() is safe from any thread
+  class Metrics {
+  public:
+    static constexpr bool enabled = true;
+
+    static uint64_t now_ns() {
+      using namespace std::chrono;
+      return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    // a poll() iteration counts as busy except for the time blocked waiting for the kernel
+    void on_loop_begin()                { loop_start_ns_ = now_ns(); }
+    void on_wait_begin()                { wait_start_ns_ = now_ns(); }
+    void on_wait_end()                  { wait_ns_ = now_ns() - wait_start_ns_; }
+    void on_events(size_t count)        { events_.add(count); }
+
+    void on_loop_end() {
+      loop_iterations_.add();
+      loop_ns_.record(now_ns() - loop_start_ns_ - wait_ns_);
+      wait_ns_ = 0;
+    }
+
+    void on_read(size_t bytes) {
+      reads_.add();
+      bytes_read_.add(bytes);
+    }
+
+    void on_write(size_t bytes) {
+      writes_.add();
+      bytes_written_.add(bytes);
+    }
+
+    void on_read_again()                { read_again_.add(); }
+    void on_write_again()               { write_again_.add(); }
+    void on_buffer_growth()             { buffer_growths_.add(); }
+    void on_accept()                    { accepts_.add(); }
+    void on_accept_failure()            { accept_failures_.add(); }
+    void on_write_queue(size_t bytes)   { write_queue_bytes_.record(bytes); }
+
+    uint64_t callback_begin() const     { return now_ns(); }
+    void callback_end(uint64_t start) {
+      callbacks_.add();
+      callback_ns_.record(now_ns() - start);
+    }
+
+    MetricsSnapshot snapshot() const {
+      MetricsSnapshot result;
+      result.loop_iterations    = loop_iterations_.load();
+      result.events             = events_.load();
+      result.reads              = reads_.load();
+      result.bytes_read         = bytes_read_.load();
+      result.read_again         = read_again_.load();
+      result.writes             = writes_.load();
+      result.bytes_written      = bytes_written_.load();
+      result.write_again        = write_again_.load();
+      result.buffer_growths     = buffer_growths_.load();
+      result.accepts            = accepts_.load();
+      result.accept_failures    = accept_failures_.load();
+      result.callbacks          = callbacks_.load();
+      result.loop_ns            = loop_ns_.snapshot();
+      result.callback_ns        = callback_ns_.snapshot();
+      result.write_queue_bytes  = write_queue_bytes_.snapshot();
+      return result;
+    }
+  private:
+    MetricCounter loop_iterations_;
+    MetricCounter events_;
+    MetricCounter reads_;
+    MetricCounter bytes_read_;
+    MetricCounter read_again_;
+    MetricCounter writes_;
+    MetricCounter bytes_written_;
+    MetricCounter write_again_;
+    MetricCounter buffer_growths_;
+    MetricCounter accepts_;
+    MetricCounter accept_failures_;
+    MetricCounter callbacks_;
+    Histogram     loop_ns_;
+    Histogram     callback_ns_;
+    Histogram     write_queue_bytes_;
+    uint64_t      loop_start_ns_ = 0;
+    uint64_t      wait_start_ns_ = 0;
+    uint64_t      wait_ns_       = 0;
+  };
+#else
+  // compiled out: every hook is an empty inline function and no clock is read, snapshot() is all zero
+  class Metrics {
+  public:
+    static constexpr bool enabled = false;
+
+    void on_loop_begin() {}
+    void on_wait_begin() {}
+    void on_wait_end() {}
+    void on_events(size_t) {}
+    void on_loop_end() {}
+    void on_read(size_t) {}
+    void on_read_again() {}
+    void on_write(size_t) {}
+    void on_write_again() {}
+    void on_buffer_growth() {}
+    void on_accept() {}
+    void on_accept_failure() {}
+    void on_write_queue(size_t) {}
+    uint64_t callback_begin() const { return 0; }
+    void callback_end(uint64_t) {}
+
+    MetricsSnapshot snapshot() const { return {}; }
+  };
+#endif // COXNET_ENABLE_METRICS
+} // namespace coxnet
+
+#endif // METRICS_H
@@ -0,0 +1,46 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+
+namespace coxnet {
+  // Lock-free multi-producer single-consumer queue of intrusive nodes, Node must have a `Node* next_`.
+  // Producers push with a CAS on the head, the consumer takes the whole list at once with an
+  // exchange, so there is no pop and no ABA problem.
+  template <typename Node>
+  class MpscQueue {
+  public:
+    MpscQueue() = default;
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(Node* node) {
+      Node* head = head_.load(std::memory_order_relaxed);
+      do {
+        node->next_ = head;
+      } while (!head_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // consumer only, returns every node pushed so far in FIFO order
+    Node* take_all() {
+      if (empty()) { return nullptr; }
+
+      Node* head      = head_.exchange(nullptr, std::memory_order_acquire);
+      Node* reversed  = nullptr;
+      while (head != nullptr) {
+        Node* next    = head->next_;
+        head->next_   = reversed;
+        reversed      = head;
+        head          = next;
+      }
+
+      return reversed;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_relaxed) == nullptr; }
+  private:
+    std::atomic<Node*> head_ = { nullptr };
+  };
+} // namespace coxnet
+
+#endif // MPSC_QUEUE_H
@@ -1,84 +1,674 @@
 #ifndef POLLER_H
 #define POLLER_H
 
+#include "conn_table.h"
 #include "io_def.h"
+#include "metrics.h"
+#include "mpsc_queue.h"
+#include "pool.h"
+#include "timer_wheel.h"
 #include "socket.h"
 
+#include <algorithm>
 #include <functional>
 #include <thread>
 #include <chrono>
 #include <ranges>
+#include <string_view>
 #include <unordered_map>
 #include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
 
 namespace coxnet {
+  // a write issued off the poller thread, copied payload is stored right after the header,
+  // owned buffers travel in slice_ without a copy. The target is resolved by id when the poller
+  // drains the queue, writes to a connection that is gone by then are dropped
+  struct WriteRequest {
+    WriteRequest* next_   = nullptr;
+    ConnId        id_     = invalid_conn_id;
+    size_t        size_   = 0;
+    BufferSlice   slice_;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+
+    static WriteRequest* create(ConnId id, const std::string_view* parts, size_t count) {
+      size_t size = 0;
+      for (size_t i = 0; i < count; i++) { size += parts[i].size(); }
+
+      auto request    = new (::operator new(sizeof(WriteRequest) + size)) WriteRequest();
+      request->id_    = id;
+      request->size_  = size;
+
+      char* dest = request->data();
+      for (size_t i = 0; i < count; i++) {
+        memcpy(dest, parts[i].data(), parts[i].size());
+        dest += parts[i].size();
+      }
+      return request;
+    }
+
+    static WriteRequest* create(ConnId id, BufferSlice&& slice) {
+      auto request    = new (::operator new(sizeof(WriteRequest))) WriteRequest();
+      request->id_    = id;
+      request->slice_ = std::move(slice);
+      return request;
+    }
+
+    static void destroy(WriteRequest* request) {
+      request->~WriteRequest();
+      ::operator delete(request);
+    }
+  };
+
   class IPoller {
+    friend class Socket;
   public:
     IPoller() {
-      cleaner_ = new Cleaner([this](const socket_t handle) {
-        auto finder = conns_.find(handle);
-        if (finder != conns_.end()) {
-          if (on_close_ != nullptr) {
-            on_close_(finder->second, finder->second->user_closed_ ? 0 : finder->second->err_);
-          }
-          
-          delete finder->second;
-          conns_.erase(finder);
-        }
-      });
+      cleaner_ = new Cleaner();
     }
 
+    // shut() reports every socket to on_close, whatever is left by now is released without a callback:
+    // the derived poller is already gone and so may be what the callbacks refer to
     virtual ~IPoller() { 
-      _cleanup();
+      _drop_pending_writes();
+      cleaner_->clear();
+
+      // the pools go away with the poller, so must every socket still allocated from them
+      for (auto& [handle, conn] : conns_) {
+        conn->_release_handle();
+        _delete_socket(conn);
+      }
+      conns_.clear();
 
       delete cleaner_;
       cleaner_ = nullptr;  
     };
 
     virtual void shut() = 0;
-    virtual void poll() = 0;
+    // wait up to timeout_ms for I/O, 0 returns immediately and -1 blocks until I/O or wakeup()
+    virtual void poll(int timeout_ms = 0) = 0;
+    // interrupt a blocking poll() from any thread
+    virtual void wakeup() = 0;
+    // blocking dial, on_data and on_close apply to the new socket only as with async_connect()
     virtual Socket* connect(const char address[], const uint16_t port,
                             DataCallback on_data, CloseCallback on_close) = 0;
+    // dial without blocking: on_connect reports the outcome from the poller thread, a handshake still
+    // pending after timeout_ms fails with ETIMEDOUT. Writes issued before that are sent once connected.
+    // nullptr when the dial could not even start (bad address, no sockets left), on_connect is not called then.
+    // on_data and on_close apply to this socket only, the poller's callbacks are used when they are nullptr
+    virtual Socket* async_connect(const char address[], const uint16_t port, ConnectCallback on_connect,
+                                  DataCallback on_data = nullptr, CloseCallback on_close = nullptr,
+                                  uint32_t timeout_ms = default_connect_timeout_ms) = 0;
     virtual bool listen(const char address[], const uint16_t port, ProtocolStack stack, 
                         ConnectionCallback on_connection, DataCallback on_data, CloseCallback on_close) = 0;
+    // stop accepting and close the listener, connections accepted so far stay. Poller thread only
+    virtual void unlisten() = 0;
     
-    void request_shutdown() { shutdown_requested_.store(true); }
+    // drive the poller on the calling thread until request_shutdown()
+    void run() {
+      while (!is_shutdown_requested()) {
+        poll(-1);
+      }
+    }
+
+    // schedule task to run on the poller thread, safe to call from any thread
+    void post(Task task) {
+      {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        tasks_.emplace_back(std::move(task));
+      }
+
+      wakeup();
+    }
+
+    // run task on the poller thread after delay_ms, then every interval_ms unless that is 0.
+    // Poller thread only, post() it from elsewhere. The id stays valid until the timer is done
+    TimerId add_timer(uint64_t delay_ms, Task task, uint64_t interval_ms = 0) {
+      auto timer          = std::make_unique<UserTimer>();
+      timer->poller       = this;
+      timer->id           = ++last_timer_id_;
+      timer->task         = std::move(task);
+      timer->interval_ms  = interval_ms;
+      timer->on_expire_   = &IPoller::_on_user_timer;
+
+      timers_.add(timer.get(), TimerWheel::now_ms() + delay_ms);
+      const TimerId id = timer->id;
+      user_timers_.emplace(id, std::move(timer));
+      return id;
+    }
+
+    // false when the timer already fired for the last time
+    bool cancel_timer(TimerId id) {
+      auto finder = user_timers_.find(id);
+      if (finder == user_timers_.end()) { return false; }
+
+      // cancelled from its own task, released once the task returns
+      if (finder->second.get() == firing_timer_) {
+        firing_timer_->interval_ms = 0;
+        return true;
+      }
+
+      timers_.cancel(finder->second.get());
+      user_timers_.erase(finder);
+      return true;
+    }
+
+    // the connection behind id, nullptr once it is released. Poller thread only
+    Socket* find(ConnId id) const { return conns_.find(id); }
+
+    // write to the connection behind id from any thread, dropped when the connection is gone by the
+    // time the poller gets to it. Returns the bytes accepted, -1 when id is known to be stale
+    int write(ConnId id, const char* data, size_t size) {
+      std::string_view part(data, size);
+      if (!in_loop_thread()) {
+        _post_write(WriteRequest::create(id, &part, 1));
+        return static_cast<int>(size);
+      }
+
+      Socket* conn = conns_.find(id);
+      return conn != nullptr ? conn->writev(&part, 1) : -1;
+    }
+
+    int write(ConnId id, std::string&& data) { return write(id, BufferSlice::from(std::move(data))); }
+    int write(ConnId id, BufferSlice slice) {
+      const int size = static_cast<int>(slice.size);
+      if (!in_loop_thread()) {
+        _post_write(WriteRequest::create(id, std::move(slice)));
+        return size;
+      }
+
+      Socket* conn = conns_.find(id);
+      return conn != nullptr ? conn->write(std::move(slice)) : -1;
+    }
+
+    void request_shutdown() { 
+      shutdown_requested_.store(true); 
+      wakeup();
+    }
     bool is_shutdown_requested() const { return shutdown_requested_.load(); }
+
+    // see Socket::enable_zerocopy()
+    void set_zerocopy_callback(ZeroCopyCallback on_release) { on_zerocopy_ = std::move(on_release); }
+
+    // see Socket::set_write_watermarks()
+    void set_watermark_callbacks(WatermarkCallback on_high, WatermarkCallback on_low) {
+      on_high_watermark_  = std::move(on_high);
+      on_low_watermark_   = std::move(on_low);
+    }
+
+    // consuming variant of DataCallback, takes precedence over it when set: bytes that are
+    // not consumed stay in the socket's read buffer, so framed protocols can parse in place
+    void set_read_callback(ReadCallback on_read) { on_read_ = std::move(on_read); }
+
+    // the poller thread is the last thread that called poll(). Until the first poll() no thread is,
+    // writes issued before that are queued and go out with it
+    bool in_loop_thread() const { return loop_thread_id_.load(std::memory_order_relaxed) == std::this_thread::get_id(); }
+
+    // size the per-poller slab pools, or disable them to use the heap directly. Only possible before
+    // the first connection, returns false once any buffer or socket is allocated. Either both pools
+    // take config or neither changes
+    bool set_pool_config(const PoolConfig& config) {
+      if (!buffer_pool_.can_configure(config.buffer_blocks_per_slab) ||
+          !socket_pool_.can_configure(config.socket_blocks_per_slab)) {
+        return false;
+      }
+
+      buffer_pool_.configure(config.buffer_blocks_per_slab, config.enabled);
+      socket_pool_.configure(config.socket_blocks_per_slab, config.enabled);
+      return true;
+    }
+
+    PoolStats buffer_pool_stats() const { return buffer_pool_.stats(); }
+
+    // loop, I/O and callback counters of this poller, all zero unless built with COXNET_ENABLE_METRICS.
+    // metrics().snapshot() may be taken from any thread
+    const Metrics& metrics() const { return metrics_; }
+    PoolStats socket_pool_stats() const { return socket_pool_.stats(); }
+
+    // bind listener with SO_REUSEPORT so that several pollers can listen on the same address,
+    // must be called before listen()
+    void set_reuse_port(bool enable) { reuse_port_ = enable; }
+
+    // auto-cork: writes issued on the poller thread during one poll() iteration are only buffered, and
+    // every socket written to is flushed once at its end, so a header and body written separately
+    // leave in one sendmsg. The io_uring poller always batches its sends this way
+    void set_auto_cork(bool enable) { auto_cork_ = enable; }
+
+    // applied to every socket accepted or dialed from now on, right after it is created. Set it
+    // before listen() and connect(), or per socket with Socket::set_options()
+    void set_socket_options(const SocketOptions& options) {
+      socket_options_     = options;
+      has_socket_options_ = true;
+    }
   protected:
-    void _close_conns_internal() {
+    // user callbacks are reached through a Callbacks type resolved at compile time, every path that
+    // reports to the user takes one. Poller uses the std::function callbacks below, BasicPoller the
+    // members of its handler. A socket's own callbacks go first either way
+    struct FunctionCallbacks {
+      IPoller* poller = nullptr;
+
+      bool consumes_reads() const { return poller->on_read_ != nullptr; }
+      size_t on_read(Socket* conn, const char* data, size_t size) const { return poller->on_read_(conn, data, size); }
+
+      void on_data(Socket* conn, const char* data, size_t size) const {
+        if (poller->on_data_ != nullptr) { poller->on_data_(conn, data, size); }
+      }
+
+      void on_connection(Socket* conn) const {
+        if (poller->on_connection_ != nullptr) { poller->on_connection_(conn); }
+      }
+
+      void on_close(Socket* conn, int err_code) const {
+        if (poller->on_close_ != nullptr) { poller->on_close_(conn, err_code); }
+      }
+    };
+
+    FunctionCallbacks _function_callbacks() { return FunctionCallbacks{ this }; }
+
+    template <typename Callbacks>
+    void _close_conns_internal(const Callbacks& callbacks) {
       for(const auto& [handle, conn] : conns_) {
         conn->_close_handle();
       }
 
       // sleep 100ms, wait io event
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      
-      for(auto& [handle, conn] : conns_) {
-        delete conn;
-      }
-      conns_.clear();
-      cleaner_->clear();
+
+      // every socket gets its on_close, the caller tears down whatever I/O is still in flight
+      _cleanup(callbacks, true);
 
       on_connection_  = nullptr;
       on_data_        = nullptr;
+      on_read_        = nullptr;
       on_close_       = nullptr;
     }
 
-    void _cleanup() const { cleaner_->traverse(); }
+    void _run_tasks() {
+      {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        if (tasks_.empty()) { return; }
+        running_tasks_.swap(tasks_);
+      }
+
+      for (auto& task : running_tasks_) {
+        task();
+      }
+      running_tasks_.clear();
+    }
+
+    // poll timeout shortened to the next timer
+    int _timer_timeout(int timeout_ms) const {
+      if (timeout_ms == 0) { return 0; }
+
+      const int next = timers_.next_timeout(TimerWheel::now_ms());
+      if (next < 0) { return timeout_ms; }
+      return timeout_ms < 0 ? next : std::min(timeout_ms, next);
+    }
+
+    void _run_timers() { timers_.advance(TimerWheel::now_ms()); }
+
+    static void _on_user_timer(TimerNode* node) {
+      auto      timer = static_cast<UserTimer*>(node);
+      IPoller*  self  = timer->poller;
+
+      self->firing_timer_ = timer;
+      timer->task();
+      self->firing_timer_ = nullptr;
+
+      if (timer->interval_ms == 0) {
+        self->user_timers_.erase(timer->id);
+        return;
+      }
+
+      self->timers_.add(timer, self->timers_.current() + timer->interval_ms);
+    }
+
+    // hand the read buffer of conn to the user, called after new data was appended to it
+    template <typename Callbacks>
+    void _dispatch_read(Socket* conn, const Callbacks& callbacks) {
+      conn->_on_read_activity();
+      SimpleBuffer* buff = conn->read_buff_;
+      if (_consumes_reads(conn, callbacks)) {
+        size_t consumed = _notify_read(conn, buff->take_data(), buff->written_size(), callbacks);
+        buff->consume(std::min(consumed, buff->written_size()));
+        buff->shrink_if_idle();
+        return;
+      }
+
+      _notify_data(conn, buff->take_data(), buff->written_size(), callbacks);
+      buff->clear();
+      buff->shrink_if_idle();
+    }
+
+    template <typename Callbacks>
+    bool _consumes_reads(const Socket* conn, const Callbacks& callbacks) const {
+      const SocketCallbacks* own = conn->callbacks_.get();
+      if (own != nullptr && (own->on_read != nullptr || own->on_data != nullptr)) { return own->on_read != nullptr; }
+      return callbacks.consumes_reads();
+    }
+
+    template <typename Callbacks>
+    size_t _notify_read(Socket* conn, const char* data, size_t size, const Callbacks& callbacks) {
+      const uint64_t  start     = metrics_.callback_begin();
+      size_t          consumed  = 0;
+      if (conn->callbacks_ != nullptr && conn->callbacks_->on_read != nullptr) {
+        consumed = conn->callbacks_->on_read(conn, data, size);
+      } else {
+        consumed = callbacks.on_read(conn, data, size);
+      }
+      metrics_.callback_end(start);
+      return consumed;
+    }
+
+    template <typename Callbacks>
+    void _notify_data(Socket* conn, const char* data, size_t size, const Callbacks& callbacks) {
+      const uint64_t start = metrics_.callback_begin();
+      if (conn->callbacks_ != nullptr && conn->callbacks_->on_data != nullptr) {
+        conn->callbacks_->on_data(conn, data, size);
+      } else {
+        callbacks.on_data(conn, data, size);
+      }
+      metrics_.callback_end(start);
+    }
+
+    template <typename Callbacks>
+    void _notify_connection(Socket* conn, const Callbacks& callbacks) { callbacks.on_connection(conn); }
+
+    template <typename Callbacks>
+    void _notify_close(Socket* conn, int err_code, const Callbacks& callbacks) {
+      if (conn->callbacks_ != nullptr && conn->callbacks_->on_close != nullptr) {
+        conn->callbacks_->on_close(conn, err_code);
+      } else {
+        callbacks.on_close(conn, err_code);
+      }
+    }
+
+    void _enter_loop() {
+      loop_thread_id_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+      corking_ = auto_cork_;
+    }
+
+    void _post_write(WriteRequest* request) {
+      pending_writes_.push(request);
+      wakeup();
+    }
+
+    // append every queued cross-thread write to its socket, then flush each socket once, together
+    // with the sockets corked during this iteration. Writes after this point are sent right away
+    void _flush_pending_writes() {
+      corking_ = false;
+
+      WriteRequest* request = pending_writes_.take_all();
+      while (request != nullptr) {
+        WriteRequest* next = request->next_;
+        Socket*       conn = conns_.find(request->id_);
+        if (conn != nullptr && conn->is_valid()) {
+          if (request->slice_.size > 0) {
+            conn->write_buff_->write(std::move(request->slice_));
+          } else {
+            conn->write_buff_->write(request->data(), request->size_);
+          }
+          conn->_check_high_watermark();
+          if (!conn->flush_queued_) {
+            conn->flush_queued_ = true;
+            flush_conns_.emplace_back(conn);
+          }
+        }
+
+        WriteRequest::destroy(request);
+        request = next;
+      }
+
+      if (flush_conns_.empty()) { return; }
+
+      for (Socket* conn : flush_conns_) {
+        conn->flush_queued_ = false;
+        if (conn->is_valid()) { conn->_flush(); }
+      }
+      flush_conns_.clear();
+    }
+
+    void _drop_pending_writes() {
+      WriteRequest* request = pending_writes_.take_all();
+      while (request != nullptr) {
+        WriteRequest* next = request->next_;
+        WriteRequest::destroy(request);
+        request = next;
+      }
+    }
+
+    // sockets live in the socket pool, their read buffer and write chunks in the buffer pool
+    template <typename... Args>
+    Socket* _new_socket(Args&&... args) {
+      return new (socket_pool_.acquire()) Socket(std::forward<Args>(args)...);
+    }
+
+    void _delete_socket(Socket* conn) {
+      timers_.cancel(&conn->idle_timer_);
+      timers_.cancel(&conn->read_timer_);
+      conn->~Socket();
+      socket_pool_.release(conn);
+    }
+
+    // every connection goes through here, gives it its id. False when the table refused it, the caller
+    // then drops conn with _discard_conn() instead of reporting it
+    bool _add_conn(Socket* conn) {
+      if (has_socket_options_) { conn->set_options(socket_options_); }
+      conn->conn_id_ = conns_.insert(conn->native_handle(), conn);
+      return conn->conn_id_ != invalid_conn_id;
+    }
+
+    // a socket that never made it into the table, no callback has seen it and nothing refers to it
+    void _discard_conn(Socket* conn) {
+      conn->_release_handle();
+      _delete_socket(conn);
+    }
+
+    // last step of a closed socket: drop it from the table, close the handle and report it,
+    // a dial that never connected is reported to its on_connect instead of on_close
+    template <typename Callbacks>
+    void _release_conn(Socket* conn, const Callbacks& callbacks) {
+      conns_.erase(conn->native_handle());
+      conn->_release_handle();
+      conn->write_buff_->fail(conn->err_ != 0 ? conn->err_ : ECANCELED);
+      if (conn->connecting_) {
+        if (conn->on_connect_ != nullptr) { conn->on_connect_(conn, conn->err_ != 0 ? conn->err_ : ECANCELED); }
+      } else {
+        _notify_close(conn, conn->user_closed_ ? 0 : conn->err_, callbacks);
+      }
+
+      _delete_socket(conn);
+    }
+
+    // conn was registered for the handshake, the connect timeout shares the read deadline timer.
+    // False when conn could not be added, see _add_conn()
+    bool _begin_connect(Socket* conn, ConnectCallback&& on_connect, DataCallback&& on_data,
+                        CloseCallback&& on_close, uint32_t timeout_ms) {
+      if (!_add_conn(conn)) { return false; }
+
+      conn->connecting_ = true;
+      conn->on_connect_ = std::move(on_connect);
+      if (timeout_ms != 0) { conn->set_read_deadline(timeout_ms); }
+
+      if (on_data != nullptr || on_close != nullptr) { conn->set_callbacks(std::move(on_data), std::move(on_close)); }
+      return true;
+    }
+
+    // the handshake of conn finished with err_code (SO_ERROR)
+    void _complete_connect(Socket* conn, int err_code) {
+      if (err_code != 0) {
+        conn->_close_handle(err_code);
+        return;
+      }
+
+      conn->connecting_ = false;
+      timers_.cancel(&conn->read_timer_);
+      if (conn->on_connect_ != nullptr) { conn->on_connect_(conn, 0); }
+      if (conn->is_valid()) { conn->_resume_after_connect(); }
+    }
+
+    // close and free the listener, the connections it accepted are not affected
+    void _delete_listener() {
+      if (sock_listener_ == nullptr) { return; }
+
+      sock_listener_->_release_handle();
+      delete sock_listener_;
+      sock_listener_ = nullptr;
+    }
+
+    // release the sockets closed since the last round, see Cleaner
+    template <typename Callbacks>
+    void _cleanup(const Callbacks& callbacks, bool force = false) {
+      cleaner_->traverse([this, &callbacks](Socket* conn) { _release_conn(conn, callbacks); }, force);
+    }
     Cleaner* _cleaner() const { return cleaner_; }
   protected:
-    using Conns = std::unordered_map<socket_t, Socket*>;
+    struct UserTimer : TimerNode {
+      IPoller*  poller      = nullptr;
+      TimerId   id          = invalid_timer_id;
+      Task      task;
+      uint64_t  interval_ms = 0;
+    };
 
     ConnectionCallback  on_connection_      = nullptr;
     DataCallback        on_data_            = nullptr;
+    ReadCallback        on_read_            = nullptr;
     CloseCallback       on_close_           = nullptr;
     ListenErrorCallback on_listen_err_      = nullptr;
+    WatermarkCallback   on_high_watermark_  = nullptr;
+    WatermarkCallback   on_low_watermark_   = nullptr;
+    ZeroCopyCallback    on_zerocopy_        = nullptr;
+    [[no_unique_address]] Metrics metrics_; // takes no space when compiled out
 
     Cleaner*            cleaner_            = nullptr;
-    Conns               conns_;
+    ConnTable           conns_;
     listener*           sock_listener_      = nullptr;
     std::atomic<bool>   shutdown_requested_ = { false };
+    bool                reuse_port_         = false;
+    bool                auto_cork_          = false;
+    bool                corking_            = false;
+    SocketOptions       socket_options_;
+    bool                has_socket_options_ = false;
+
+    std::mutex          tasks_mutex_;
+    std::vector<Task>   tasks_;
+    std::vector<Task>   running_tasks_;
+
+    SlabPool            buffer_pool_        = SlabPool(max_read_buff_size);
+    SlabPool            socket_pool_        = SlabPool(sizeof(Socket));
+
+    TimerWheel                                              timers_;
+    std::unordered_map<TimerId, std::unique_ptr<UserTimer>> user_timers_;
+    UserTimer*                                              firing_timer_   = nullptr;
+    TimerId                                                 last_timer_id_  = invalid_timer_id;
+
+    std::atomic<std::thread::id>  loop_thread_id_;
+    MpscQueue<WriteRequest>       pending_writes_;
+    std::vector<Socket*>          flush_conns_;
   };
+
+  inline bool Socket::_in_loop_thread() const { return poller_ == nullptr || poller_->in_loop_thread(); }
+
+  inline void Socket::_on_sent(size_t bytes) {
+    if (poller_ != nullptr) { poller_->metrics_.on_write(bytes); }
+  }
+
+  inline void Socket::_on_send_again() {
+    if (poller_ != nullptr) { poller_->metrics_.on_write_again(); }
+  }
+
+  inline void Socket::_on_queued() {
+    if (poller_ != nullptr) { poller_->metrics_.on_write_queue(write_buff_->size()); }
+  }
+
+  inline bool Socket::_cork() {
+    if (poller_ == nullptr || !poller_->corking_ || wait_writable_) { return false; }
+
+    if (!flush_queued_) {
+      flush_queued_ = true;
+      poller_->flush_conns_.emplace_back(this);
+    }
+    return true;
+  }
+
+  inline void Socket::set_idle_timeout(uint32_t timeout_ms) {
+    idle_timeout_ms_ = timeout_ms;
+    if (poller_ == nullptr) { return; }
+
+    if (timeout_ms == 0 || !is_valid()) {
+      poller_->timers_.cancel(&idle_timer_);
+      return;
+    }
+
+    last_active_ms_ = TimerWheel::now_ms();
+    poller_->timers_.add(&idle_timer_, last_active_ms_ + timeout_ms);
+  }
+
+  inline void Socket::set_read_deadline(uint32_t timeout_ms) {
+    if (poller_ == nullptr) { return; }
+
+    if (timeout_ms == 0 || !is_valid()) {
+      poller_->timers_.cancel(&read_timer_);
+      return;
+    }
+
+    poller_->timers_.add(&read_timer_, TimerWheel::now_ms() + timeout_ms);
+  }
+
+  inline void Socket::_mark_active() { last_active_ms_ = poller_->timers_.current(); }
+
+  inline void Socket::_on_read_activity() {
+    _touch();
+    if (read_timer_.pending()) { poller_->timers_.cancel(&read_timer_); }
+  }
+
+  // not idle after all: sleep until the deadline that the last activity implies
+  inline void Socket::_on_idle_timer(TimerNode* node) {
+    Socket* conn = static_cast<SocketTimer*>(node)->conn;
+    if (!conn->is_valid() || conn->idle_timeout_ms_ == 0) { return; }
+
+    TimerWheel&     timers    = conn->poller_->timers_;
+    const uint64_t  deadline  = conn->last_active_ms_ + conn->idle_timeout_ms_;
+    if (deadline > timers.current()) {
+      timers.add(node, deadline);
+      return;
+    }
+
+    conn->_close_handle(ETIMEDOUT);
+  }
+
+  inline void Socket::_on_read_timer(TimerNode* node) {
+    Socket* conn = static_cast<SocketTimer*>(node)->conn;
+    if (conn->is_valid()) { conn->_close_handle(ETIMEDOUT); }
+  }
+
+  inline void Socket::_fire_watermark(bool high) {
+    const WatermarkCallback& callback = high ? poller_->on_high_watermark_ : poller_->on_low_watermark_;
+    if (callback != nullptr) { callback(this, write_buff_->size()); }
+  }
+
+  inline SlabPool* Socket::_buffer_pool() const { return poller_ != nullptr ? &poller_->buffer_pool_ : nullptr; }
+
+  // a socket the poller already closed takes nothing, whatever is still queued for it is dropped
+  inline int Socket::_post_write(const std::string_view* parts, size_t count) {
+    if (closed_.load(std::memory_order_acquire)) { return 0; }
+
+    WriteRequest* request = WriteRequest::create(conn_id_, parts, count);
+    const int     size    = static_cast<int>(request->size_);
+    poller_->_post_write(request);
+    return size;
+  }
+
+  inline int Socket::_post_write(BufferSlice&& slice) {
+    if (closed_.load(std::memory_order_acquire)) { return 0; }
+
+    const int size = static_cast<int>(slice.size);
+    poller_->_post_write(WriteRequest::create(conn_id_, std::move(slice)));
+    return size;
+  }
 } // namespace coxnet
 
 #endif // POLLER_H
@@ -0,0 +1,107 @@
+#ifndef POLLER_GROUP_H
+#define POLLER_GROUP_H
+
+#include "coxnet.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace coxnet {
+  // Multi-reactor mode: N pollers running on N threads. listen() makes every poller bind
+  // its own SO_REUSEPORT listener on the same address, so the kernel shards incoming
+  // connections between them. Each poller owns its connection table, callbacks are invoked
+  // on the thread of the poller that accepted the connection.
+  class PollerGroup {
+  public:
+    explicit PollerGroup(size_t count = std::thread::hardware_concurrency()) {
+      count = std::max<size_t>(count, 1);
+      for (size_t i = 0; i < count; i++) {
+        pollers_.emplace_back(std::make_unique<Poller>());
+      }
+    }
+
+    ~PollerGroup() { shut(); }
+
+    PollerGroup(const PollerGroup&) = delete;
+    PollerGroup& operator=(const PollerGroup&) = delete;
+    PollerGroup(PollerGroup&& other) = delete;
+    PollerGroup& operator=(PollerGroup&& other) = delete;
+
+    // callbacks are copied into every poller, so they must be safe to run concurrently. A unix path can
+    // only be bound once, the first poller accepts every connection then. All or nothing: when one poller
+    // fails, the listeners already opened are closed again and the group stays usable
+    bool listen(const char address[], const uint16_t port, ProtocolStack stack,
+                const ConnectionCallback& on_connection, const DataCallback& on_data, const CloseCallback& on_close) {
+      if (!threads_.empty() || pollers_.empty()) {
+        return false;
+      }
+
+      const size_t count = ip_address_type(address) == IPType::kUnix ? 1 : pollers_.size();
+      for (size_t i = 0; i < count; i++) {
+        pollers_[i]->set_reuse_port(count > 1);
+        if (!pollers_[i]->listen(address, port, stack, on_connection, on_data, on_close)) {
+          for (size_t j = 0; j < i; j++) {
+            pollers_[j]->unlisten();
+          }
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    // see IPoller::set_socket_options(), call it before listen()
+    void set_socket_options(const SocketOptions& options) {
+      for (auto& poller : pollers_) {
+        poller->set_socket_options(options);
+      }
+    }
+
+    void start() {
+      if (!threads_.empty()) {
+        return;
+      }
+
+      for (auto& poller : pollers_) {
+        Poller* p = poller.get();
+        threads_.emplace_back([p] { p->run(); });
+      }
+    }
+
+    void shut() {
+      for (auto& poller : pollers_) {
+        poller->request_shutdown();
+      }
+
+      for (auto& thread : threads_) {
+        if (thread.joinable()) { thread.join(); }
+      }
+      threads_.clear();
+
+      // threads are gone, safe to release the resources of every poller from here
+      for (auto& poller : pollers_) {
+        poller->shut();
+      }
+      pollers_.clear();
+    }
+
+    // counters and histograms summed over every poller, safe to call while they run
+    MetricsSnapshot metrics_snapshot() const {
+      MetricsSnapshot total;
+      for (const auto& poller : pollers_) {
+        total += poller->metrics().snapshot();
+      }
+      return total;
+    }
+
+    size_t size() const { return pollers_.size(); }
+    Poller* at(size_t index) const { return index < pollers_.size() ? pollers_[index].get() : nullptr; }
+  private:
+    std::vector<std::unique_ptr<Poller>> pollers_;
+    std::vector<std::thread>             threads_;
+  };
+} // namespace coxnet
+
+#endif // POLLER_GROUP_H
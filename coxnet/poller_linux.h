@@ -5,12 +5,18 @@
 
 #include "io_def.h"
 #include "poller.h"
+#include "posix_socket.h"
 #include "socket.h"
+#include "udp_socket.h"
 
 #include <cassert>
 #include <chrono>
 #include <set>
 #include <thread>
+#include <vector>
+
+#include <linux/errqueue.h>
+#include <sys/eventfd.h>
 
 
 namespace coxnet {
@@ -20,99 +26,84 @@ namespace coxnet {
       epoll_events_ = new epoll_event[max_epoll_event_count];
       epoll_fd_     = epoll_create1(EPOLL_CLOEXEC);
       assert(epoll_fd_);
+
+      wakeup_fd_    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      assert(wakeup_fd_ != -1);
+
+      epoll_event ev  = {};
+      ev.events       = EPOLLIN;
+      ev.data.ptr     = &wakeup_fd_;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+    }
+
+    // the sockets are left to ~IPoller, only the poller's own handles are closed here
+    ~Poller() override {
+      udp_sockets_.release(true);
+      _delete_listener();
+
+      if (epoll_fd_ != -1) { close(epoll_fd_); }
+      if (wakeup_fd_ != -1) { close(wakeup_fd_); }
+      delete[] epoll_events_;
     }
 
-    ~Poller() = default;
     Poller(const Poller&) = delete;
     Poller& operator=(const Poller&) = delete;
     Poller(Poller&& other) = delete;
     Poller& operator=(Poller&& other) = delete;
 
     Socket* connect(const char address[], const uint16_t port, DataCallback on_data, CloseCallback on_close) override {
-      IPType ip_type = ip_address_type(std::string(address));
-      if (ip_type == IPType::kInvalid) {
-        return nullptr;
-      }
-
-      int               af_family           = 0;
-      sockaddr_storage  remote_addr_storage = {};
-      socklen_t         addr_len            = 0;
-      memset(&remote_addr_storage, 0, sizeof(remote_addr_storage));
-
-      if (ip_type == IPType::kIPv4) {
-        af_family                 = AF_INET;
-        sockaddr_in* remote_addr  = reinterpret_cast<sockaddr_in*>(&remote_addr_storage);
-        remote_addr->sin_family   = af_family;
-        remote_addr->sin_port     = htons(port);
-        if (inet_pton(af_family, address, &remote_addr->sin_addr) <= 0) {
-          return nullptr;
-        }
-
-        addr_len = sizeof(sockaddr_in);
-      }
-
-      if (ip_type == IPType::kIPv6) {
-        af_family                   = AF_INET6;
-        sockaddr_in6* remote_addr6  = reinterpret_cast<sockaddr_in6*>(&remote_addr_storage);
-        remote_addr6->sin6_family   = af_family;
-        remote_addr6->sin6_port     = htons(port);
-        if (inet_pton(af_family, address, &remote_addr6->sin6_addr) <= 0) {
-          return nullptr;
-        }
-        
-        addr_len = sizeof(sockaddr_in6);
-      }
-
-      socket_t sock_handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      socket_t sock_handle = open_connect_socket(address, port);
       if (sock_handle == invalid_socket) {
         return nullptr;
       }
 
-      if (!Socket::_set_non_blocking(sock_handle)) {
+      auto conn = _new_socket(sock_handle, _cleaner(), epoll_fd_, this);
+      epoll_event ev  = {};
+      ev.events       = EPOLLIN | EPOLLET | EPOLLHUP;
+      ev.data.ptr     = conn;
+      int result = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock_handle, &ev);
+      if (result != 0) {
         ::close(sock_handle);
+        _delete_socket(conn);
         return nullptr;
       }
 
-      // EINPROGRESS is mean of async operation is in progress, ignore this error code
-      int result = ::connect(sock_handle, reinterpret_cast<sockaddr*>(&remote_addr_storage), addr_len);
-      if (result == SOCKET_ERROR) {
-        if (get_last_error() != EINPROGRESS) {
-          ::close(sock_handle);
-          return nullptr;
-        }
+      conn->_set_remote_addr(address, port);
+      if (!_add_conn(conn)) {
+        _discard_conn(conn);
+        return nullptr;
       }
 
-      if (result == SOCKET_ERROR && get_last_error() == EINPROGRESS) {
-        fd_set write_set;
-        FD_ZERO(&write_set);
-        FD_SET(sock_handle, &write_set);
-
-        timeval timeout{ 5, 0 };
-        // use select to ensure connect operation succeed
-        result = select((int)(sock_handle + 1), nullptr, &write_set, nullptr, &timeout);
-        if (result != 1) {
-          ::close(sock_handle);
-          return nullptr;
-        }
+      if (on_data != nullptr || on_close != nullptr) { conn->set_callbacks(std::move(on_data), std::move(on_close)); }
+
+      return conn;
+    }
+
+    Socket* async_connect(const char address[], const uint16_t port, ConnectCallback on_connect,
+                          DataCallback on_data = nullptr, CloseCallback on_close = nullptr,
+                          uint32_t timeout_ms = default_connect_timeout_ms) override {
+      socket_t sock_handle = open_async_connect_socket(address, port);
+      if (sock_handle == invalid_socket) {
+        return nullptr;
       }
 
-      auto conn = new Socket(sock_handle, _cleaner(), epoll_fd_);
+      // the socket turns writable when the handshake is done, either way
+      auto conn = _new_socket(sock_handle, _cleaner(), epoll_fd_, this);
       epoll_event ev  = {};
-      ev.events       = EPOLLIN | EPOLLET | EPOLLHUP;
+      ev.events       = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
       ev.data.ptr     = conn;
-      result = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock_handle, &ev);
-      if (result != 0) {
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock_handle, &ev) != 0) {
         ::close(sock_handle);
-        delete conn;
+        _delete_socket(conn);
         return nullptr;
       }
 
+      conn->wait_writable_ = true;
       conn->_set_remote_addr(address, port);
-      conns_.emplace(conn->native_handle(), conn);
-
-      on_data_  = std::move(on_data);
-      on_close_ = std::move(on_close);
-
+      if (!_begin_connect(conn, std::move(on_connect), std::move(on_data), std::move(on_close), timeout_ms)) {
+        _discard_conn(conn);
+        return nullptr;
+      }
       return conn;
     }
 
@@ -122,91 +113,16 @@ namespace coxnet {
         return false;
       }
 
-      IPType ip_type = ip_address_type(std::string(address));
-      if (ip_type == IPType::kInvalid) {
-        return false;
-      }
-
-      int af_family = 0;
-      int dual_mode = 0;
-      if (ip_type == IPType::kIPv4 && stack == ProtocolStack::kOnlyIPv4) {
-        af_family = AF_INET;
-      }
-
-      if (ip_type == IPType::kIPv6 && stack == ProtocolStack::kOnlyIPv6) {
-        af_family = AF_INET6;
-      }
-
-      // for dual stack: supports both IPv4 and IPv6 simultaneously
-      if (ip_type == IPType::kIPv6 && stack == ProtocolStack::kDualStack) {
-        af_family = AF_INET6;
-        dual_mode = 1;
-      }
-
-      if (af_family == 0) { return false; }
-
-      sockaddr_storage  local_addr_storage  = {};
-      socklen_t         addr_len            = 0;
-      memset(&local_addr_storage, 0, sizeof(local_addr_storage));
-
-      if (af_family == AF_INET) {
-        sockaddr_in* local_addr   = reinterpret_cast<sockaddr_in*>(&local_addr_storage);
-        local_addr->sin_family    = AF_INET;
-        local_addr->sin_port      = htons(port);
-        if (inet_pton(AF_INET, address, &local_addr->sin_addr) <= 0) { return false; }
-        addr_len = sizeof(sockaddr_in);
-      } 
-
-      if (af_family == AF_INET6) {
-        sockaddr_in6* local_addr6 = reinterpret_cast<sockaddr_in6*>(&local_addr_storage);
-        local_addr6->sin6_family  = AF_INET6;
-        local_addr6->sin6_port    = htons(port);
-        if (inet_pton(AF_INET6, address, &local_addr6->sin6_addr) <= 0) { return false; }
-        addr_len = sizeof(sockaddr_in6);
-      }
-
-      socket_t sock_handle = ::socket(af_family, SOCK_STREAM, IPPROTO_TCP); // Use IPPROTO_TCP for stream
+      socket_t sock_handle = open_listen_socket(address, port, stack, reuse_port_);
       if (sock_handle == invalid_socket) { return false; }
 
-      int reuse_addr = 1;
-      if (::setsockopt(sock_handle, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr)) == SOCKET_ERROR) {
-        ::close(get_last_error()); 
-        return false;
-      }
-
-      // for dual protocol stack
-      if (af_family == AF_INET6 && dual_mode == 1) {
-        int ipv6_only = 0;
-        if (::setsockopt(sock_handle, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6_only, sizeof(ipv6_only)) == SOCKET_ERROR) {
-          if (ipv6_only == 0) {
-            ::close(sock_handle);
-            return false;
-          }
-        }
-      }
-
-      if (::bind(sock_handle, reinterpret_cast<sockaddr*>(&local_addr_storage), addr_len) == SOCKET_ERROR) {
-        ::close(sock_handle); 
-        return false;
-      }
-
-      if (::listen(sock_handle, SOMAXCONN) == SOCKET_ERROR) { // Use SOMAXCONN for backlog
-        ::close(sock_handle); 
-        return false;
-      }
-
-      if (!Socket::_set_non_blocking(sock_handle)) {
-        ::close(sock_handle); 
-        return false;
-      }
-
-      sock_listener_ = new listener(sock_handle); 
+      // events of the listener point at the member, an event left in the batch after unlisten() sees it empty
+      sock_listener_ = new listener(sock_handle, address);
       epoll_event ev = {};
       ev.events      = EPOLLIN | EPOLLET; 
-      ev.data.ptr    = sock_listener_ ;
+      ev.data.ptr    = &sock_listener_;
       if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock_handle, &ev) != 0) {
-        ::close(sock_handle);
-        delete sock_listener_;
+        _delete_listener();
         return false;
       }
 
@@ -216,40 +132,115 @@ namespace coxnet {
 
       return true;
     }
+
+    void unlisten() override { _delete_listener(); }
     
-    void poll() override {
+    // bytes read from one socket before the loop moves on to the next one, a socket with more data
+    // is read again on the next iteration, round-robin with the others. 0 reads until EAGAIN
+    void set_read_budget(size_t bytes) { read_budget_ = bytes; }
+
+    // a UDP socket bound to address:port, every recvmmsg batch goes to on_datagrams. Released by
+    // UdpSocket::close() or shut()
+    UdpSocket* bind_udp(const char address[], uint16_t port, DatagramCallback on_datagrams) {
+      socket_t sock_handle = open_udp_socket(address, port, reuse_port_);
+      if (sock_handle == invalid_socket) { return nullptr; }
+
+      auto udp        = new UdpSocket(sock_handle, this, std::move(on_datagrams), epoll_fd_);
+      epoll_event ev  = {};
+      ev.events       = EPOLLIN | EPOLLET;
+      ev.data.ptr     = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(udp) | udp_event_tag);
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock_handle, &ev) != 0) {
+        delete udp;
+        return nullptr;
+      }
+
+      udp_sockets_.add(udp);
+      return udp;
+    }
+
+    void poll(int timeout_ms = 0) override { _poll(timeout_ms, _function_callbacks()); }
+
+    void wakeup() override {
+      if (wakeup_fd_ == -1) { return; }
+
+      // one pending notification is enough, skip the syscall while the poller has not consumed it yet
+      if (wakeup_pending_.exchange(true)) { return; }
+
+      uint64_t one = 1;
+      [[maybe_unused]] ssize_t n = ::write(wakeup_fd_, &one, sizeof(one));
+    }
+
+    void shut() override { _shut(_function_callbacks()); }
+  protected:
+    // poll() and shut() with the user callbacks bound at compile time, see IPoller::FunctionCallbacks
+    template <typename Callbacks>
+    void _poll(int timeout_ms, const Callbacks& callbacks) {
       if (epoll_fd_ == -1) { return; }
       if (shutdown_requested_.load()) { return; }
 
-      _poll_once(); 
-      _cleanup(); 
+      _enter_loop();
+      metrics_.on_loop_begin();
+      _poll_once(_timer_timeout(timeout_ms), callbacks); 
+      _run_timers();
+      _run_tasks();
+      _flush_pending_writes();
+      udp_sockets_.flush();
+      _cleanup(callbacks); 
+      udp_sockets_.release();
+      metrics_.on_loop_end();
     }
 
-    void shut() override {
-      if (sock_listener_ != nullptr && sock_listener_->native_handle() != invalid_socket) {
-        sock_listener_->_close_handle(0);
-      }
-
-      IPoller::_close_conns_internal();
+    template <typename Callbacks>
+    void _shut(const Callbacks& callbacks) {
+      _delete_listener();
+      IPoller::_drop_pending_writes();
+      IPoller::_close_conns_internal(callbacks);
+      udp_sockets_.release(true);
 
       if (epoll_fd_ != -1) {
         close(epoll_fd_);
         epoll_fd_ = -1;
       }
 
+      if (wakeup_fd_ != -1) {
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+      }
+
       delete[] epoll_events_;
       epoll_events_ =nullptr;
-
-      delete sock_listener_;
-      sock_listener_ = nullptr;
     }
-  protected:
-    void _poll_once() {
+
+    template <typename Callbacks>
+    void _poll_once(int timeout_ms, const Callbacks& callbacks) {
       if (epoll_fd_ == -1 || epoll_events_ == nullptr) { return; }
 
-      int count = epoll_wait(epoll_fd_, epoll_events_, max_epoll_event_count, 0);
+      // sockets left over budget are due first, epoll only gets a look without blocking then
+      _read_ready_conns(callbacks);
+      if (!ready_conns_.empty()) { timeout_ms = 0; }
+
+      metrics_.on_wait_begin();
+      int count = epoll_wait(epoll_fd_, epoll_events_, max_epoll_event_count, timeout_ms);
+      metrics_.on_wait_end();
+      if (count > 0) { metrics_.on_events(static_cast<size_t>(count)); }
       for (int i = 0; i < count; i++) {
         epoll_event*  ev    = &epoll_events_[i];
+        if (ev->data.ptr == &wakeup_fd_) {
+          _consume_wakeup();
+          continue;
+        }
+
+        if (ev->data.ptr == &sock_listener_) {
+          if (!_on_listener_event(ev->events, callbacks)) { break; }
+          continue;
+        }
+
+        if (reinterpret_cast<uintptr_t>(ev->data.ptr) & udp_event_tag) {
+          auto udp = reinterpret_cast<UdpSocket*>(reinterpret_cast<uintptr_t>(ev->data.ptr) & ~udp_event_tag);
+          if (udp->is_valid()) { udp->_read_batches(); }
+          continue;
+        }
+
         Socket*       conn  = static_cast<Socket*>(ev->data.ptr);
 
         // Fatal error if conn is nil
@@ -258,7 +249,30 @@ namespace coxnet {
           continue;
         }
 
-        bool is_listener_event = (sock_listener_ != nullptr && conn == sock_listener_);
+        // closed earlier in this batch, it is only waiting for the cleaner
+        if (!conn->is_valid()) { continue; }
+
+        // first event of a dial, after that it is handled like any other connection
+        if (conn->connecting_) {
+          _complete_connect(conn, connect_result(conn->native_handle()));
+          if (!conn->is_valid()) { continue; }
+        }
+
+        // zero-copy completions raise EPOLLERR without the socket being in error
+        if ((ev->events & EPOLLERR) && conn->zerocopy_threshold_ != 0) {
+          const int err_code = _read_zerocopy_completions(conn);
+          if (err_code != 0) { conn->_close_handle(err_code); }
+          if (!conn->is_valid()) { continue; }
+
+          ev->events &= ~EPOLLERR;
+        }
+
+        // half-closed while paused: the unread data and the EOF are picked up after resume_reading()
+        if (conn->reading_paused_ && (ev->events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) == EPOLLRDHUP) {
+          if (ev->events & EPOLLOUT) { conn->_write_by_io_event(); }
+          continue;
+        }
+
         if (ev->events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
           int err_code = 0;
           if (ev->events & EPOLLERR) {
@@ -269,47 +283,96 @@ namespace coxnet {
           // For EPOLLHUP/EPOLLRDHUP, err_code might be 0. We treat it as a clean close by peer.
           // If data is readable (EPOLLIN is also set), read it before closing.
           if ((ev->events & EPOLLIN) || (ev->events & EPOLLHUP)) {
-            _try_read(conn);
+            _try_read(conn, 0, callbacks);
           }
           
           err_code = err_code ? err_code : EIO; // give EIO for HUP/RDHUP if no specific socket error
-          if (is_listener_event) {
-            sock_listener_->_close_handle(err_code);
-            if (on_listen_err_) { on_listen_err_(err_code); }
-            
-            request_shutdown();
-            break;
-          }
-            
           conn->_close_handle(err_code); 
           continue;
         }
 
-        if (is_listener_event && (ev->events & EPOLLIN)) {
-          _accept_connections(); 
-          if (sock_listener_ && sock_listener_->err_ != 0 && on_listen_err_ != nullptr) {
-            on_listen_err_(sock_listener_->err_);
-
-            request_shutdown();
-            break;
-          }
-
-          continue;
-        }
-
         if (ev->events & EPOLLOUT) {
           conn->_write_by_io_event();
-          if (conn->is_valid()) { continue; }
+          if (!conn->is_valid()) { continue; }
         }
         
-        if (ev->events & EPOLLIN) {
-          _try_read(conn);
+        // a socket in the ready list is read on its turn, another event does not earn it extra
+        if ((ev->events & EPOLLIN) && !conn->read_ready_) {
+          _try_read(conn, read_budget_, callbacks);
           if (conn->is_valid()) { continue; }
         }
       }
     }
   private:
-    void _accept_connections() {
+    // false when the listener failed, the poller is shutting down then
+    template <typename Callbacks>
+    bool _on_listener_event(uint32_t events, const Callbacks& callbacks) {
+      // closed by unlisten() earlier in this batch
+      if (sock_listener_ == nullptr || !sock_listener_->is_valid()) { return true; }
+
+      if (events & (EPOLLERR | EPOLLHUP)) {
+        int       err_code  = 0;
+        socklen_t err_len   = sizeof(err_code);
+        getsockopt(sock_listener_->native_handle(), SOL_SOCKET, SO_ERROR, &err_code, &err_len);
+        err_code = err_code ? err_code : EIO;
+
+        sock_listener_->_close_handle(err_code);
+        if (on_listen_err_) { on_listen_err_(err_code); }
+
+        request_shutdown();
+        return false;
+      }
+
+      _accept_connections(callbacks);
+      if (sock_listener_ && sock_listener_->err_ != 0 && on_listen_err_ != nullptr) {
+        on_listen_err_(sock_listener_->err_);
+
+        request_shutdown();
+        return false;
+      }
+      return true;
+    }
+
+    // drain the error queue and release what the completed sends held, returns the pending socket error
+    int _read_zerocopy_completions(Socket* conn) {
+      size_t released = 0;
+      while (true) {
+        char    control[128];
+        msghdr  msg         = {};
+        msg.msg_control     = control;
+        msg.msg_controllen  = sizeof(control);
+        if (::recvmsg(conn->native_handle(), &msg, MSG_ERRQUEUE) < 0) { break; }
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+          const bool recv_err = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                                (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+          if (!recv_err) { continue; }
+
+          auto serr = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+          if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY && serr->ee_errno == 0) {
+            // ee_info..ee_data is the range of completed sends
+            released += conn->write_buff_->release_zerocopy(serr->ee_data);
+          }
+        }
+      }
+
+      if (released > 0 && on_zerocopy_ != nullptr) { on_zerocopy_(conn, released); }
+
+      int       err_code  = 0;
+      socklen_t err_len   = sizeof(err_code);
+      getsockopt(conn->native_handle(), SOL_SOCKET, SO_ERROR, &err_code, &err_len);
+      return err_code;
+    }
+
+    void _consume_wakeup() {
+      // clear the flag before tasks are drained, a post() racing with the drain will wake us again
+      uint64_t value = 0;
+      [[maybe_unused]] ssize_t n = ::read(wakeup_fd_, &value, sizeof(value));
+      wakeup_pending_.store(false);
+    }
+
+    template <typename Callbacks>
+    void _accept_connections(const Callbacks& callbacks) {
       if (sock_listener_ == nullptr || !sock_listener_->is_valid() || epoll_fd_ == -1) { return; }
 
       while (true) {
@@ -324,37 +387,23 @@ namespace coxnet {
           int         err_code  = get_last_error();
           ErrorAction action    = handle_error_action(err_code);
           if (action == ErrorAction::kRetry) { break; }
+
+          metrics_.on_accept_failure();
           if (action == ErrorAction::kContinue) { continue; }
 
           sock_listener_->_close_handle(err_code);
           break;
         }
 
-        // Socket::_set_non_blocking not needed due to accept4 SOCK_NONBLOCK
+        // set_non_blocking not needed due to accept4 SOCK_NONBLOCK
         // But if not using accept4, it would be:
-        // if (!Socket::_set_non_blocking(handle)) { ::close(handle); continue; }
+        // if (!set_non_blocking(handle)) { ::close(handle); continue; }
         
         char      client_ip_str[INET6_ADDRSTRLEN] = { 0 };
         uint16_t  client_port                     = 0;
+        address_to_string(remote_addr_storage, client_ip_str, client_port);
 
-        switch (remote_addr_storage.ss_family) {
-        case AF_INET: {
-          sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(&remote_addr_storage);
-          inet_ntop(AF_INET, &sin->sin_addr, client_ip_str, sizeof(client_ip_str));
-          client_port = ntohs(sin->sin_port);
-          break;
-        }
-        case AF_INET6: {
-          sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(&remote_addr_storage);
-          inet_ntop(AF_INET6, &sin6->sin6_addr, client_ip_str, sizeof(client_ip_str));
-          client_port = ntohs(sin6->sin6_port);
-          break;
-        }
-        default:
-          break;
-        }
-
-        auto conn = new Socket(handle, _cleaner(), epoll_fd_);
+        auto conn = _new_socket(handle, _cleaner(), epoll_fd_, this);
         conn->_set_remote_addr(client_ip_str, client_port);
 
         // Add to epoll. EPOLLRDHUP for peer close.
@@ -362,52 +411,105 @@ namespace coxnet {
         ev.events       = EPOLLIN | EPOLLET | EPOLLRDHUP;
         ev.data.ptr     = conn;
         if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, handle, &ev) != 0) {
-          // Failed to add to epoll, close and delete this connection
-          // conn destructor will call ::close() if handle is valid.
-          // Or call conn->_close_handle() explicitly.
-          conn->_close_handle(get_last_error());
-          delete conn;
+          // Failed to add to epoll, close and delete this connection, it was never reported
+          metrics_.on_accept_failure();
+          conn->_release_handle();
+          _delete_socket(conn);
           continue;
         }
 
-        conns_.emplace(conn->native_handle(), conn);
-        if (on_connection_ != nullptr) { on_connection_(conn); }
+        if (!_add_conn(conn)) {
+          metrics_.on_accept_failure();
+          _discard_conn(conn);
+          continue;
+        }
+
+        metrics_.on_accept();
+        _notify_connection(conn, callbacks);
       }
     }
 
-    void _try_read(Socket* conn) {
-      auto    conn_fd       = conn->native_handle();
+    // read until EAGAIN or until budget bytes were read, 0 is unlimited. A socket that still has data
+    // goes to the ready list, edge-triggered epoll would not report it again
+    template <typename Callbacks>
+    void _try_read(Socket* conn, size_t budget, const Callbacks& callbacks) {
       int     read_n        = -1;
       size_t  readed_total  = 0;
 
-      while (true) {
-        if (conn->read_buff_->writable_size() <= 0) { 
-          conn->read_buff_->ensure_writable_size(max_size_per_read); 
+      // a paused socket leaves the rest in the kernel, resume_reading() re-arms EPOLLIN to pick it up
+      while (!conn->reading_paused_) {
+        if (budget != 0 && readed_total >= budget) {
+          conn->read_ready_ = true;
+          ready_conns_.emplace_back(conn->id());
+          break;
+        }
+
+        if (conn->read_buff_->writable_size() < max_size_per_read) {
+          const size_t capacity = conn->read_buff_->capacity();
+          if (!conn->read_buff_->ensure_writable_size(max_size_per_read)) {
+            conn->_close_handle(ENOBUFS);
+            break;
+          }
+          if (conn->read_buff_->capacity() != capacity) { metrics_.on_buffer_growth(); }
         }
         
-        auto buffer_start = conn->read_buff_->take_data();
+        auto buffer_start = conn->read_buff_->writable_data();
         read_n = ::recv(conn->native_handle(), buffer_start, conn->read_buff_->writable_size(), 0);
         if (read_n > 0) {
           readed_total += read_n;
+          metrics_.on_read(static_cast<size_t>(read_n));
           conn->read_buff_->add_written_from_external_write(read_n);
-          if (on_data_ != nullptr) {
-            on_data_(conn, conn->read_buff_->take_data(), conn->read_buff_->written_size());
-          }
-          conn->read_buff_->clear();
+          _dispatch_read(conn, callbacks);
+          if (!conn->is_valid()) { break; }
           continue;
         } 
+
+        // peer closed, errno is not set here. EIO as for EPOLLRDHUP
+        if (read_n == 0) {
+          conn->_close_handle(EIO);
+          break;
+        }
         
         int err_code = get_last_error();
-        if (handle_error_action(err_code) == ErrorAction::kRetry) { break; } 
+        if (handle_error_action(err_code) == ErrorAction::kRetry) {
+          metrics_.on_read_again();
+          break;
+        } 
         if (handle_error_action(err_code) == ErrorAction::kContinue) { continue; }
 
         conn->_close_handle(err_code);
         break;
       }
     }
+
+    // one budget for every socket queued in the previous iteration, by id since a socket closed in
+    // the meantime may already be released
+    template <typename Callbacks>
+    void _read_ready_conns(const Callbacks& callbacks) {
+      if (ready_conns_.empty()) { return; }
+
+      reading_conns_.swap(ready_conns_);
+      for (ConnId id : reading_conns_) {
+        Socket* conn = conns_.find(id);
+        if (conn == nullptr) { continue; }
+
+        conn->read_ready_ = false;
+        if (conn->is_valid()) { _try_read(conn, read_budget_, callbacks); }
+      }
+      reading_conns_.clear();
+    }
   private:
+    // marks UDP sockets in epoll_event::data, both socket types are at least pointer aligned
+    static constexpr uintptr_t udp_event_tag = 1;
+
     int                 epoll_fd_       = -1;
     epoll_event*        epoll_events_   = nullptr;
+    UdpSockets          udp_sockets_;
+    size_t              read_budget_    = read_budget_per_event;
+    std::vector<ConnId> ready_conns_;
+    std::vector<ConnId> reading_conns_;
+    int                 wakeup_fd_      = -1;
+    std::atomic<bool>   wakeup_pending_ = { false };
   };
 } // namespace coxnet
 
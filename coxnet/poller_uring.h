@@ -0,0 +1,1022 @@
+#ifndef POLLER_URING_H
+#define POLLER_URING_H
+
+#if defined(__linux__) && defined(COXNET_USE_IO_URING)
+
+#include "io_def.h"
+#include "poller.h"
+#include "posix_socket.h"
+#include "socket.h"
+#include "udp_socket.h"
+
+#include <algorithm>
+#include <cassert>
+#include <csignal>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace coxnet {
+  // Minimal io_uring ring driven by raw syscalls: submission/completion queues plus one
+  // provided buffer ring used by multishot recv.
+  class UringRing {
+  public:
+    UringRing() = default;
+    ~UringRing() { destroy(); }
+
+    UringRing(const UringRing&) = delete;
+    UringRing& operator=(const UringRing&) = delete;
+
+    bool init(unsigned entries) {
+      io_uring_params params = {};
+      params.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+      params.cq_entries = entries * 4;
+
+      ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+      if (ring_fd_ < 0) {
+        // older kernels reject the optional flags
+        params        = {};
+        params.flags  = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        ring_fd_      = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+      }
+
+      if (ring_fd_ < 0) {
+        ring_fd_ = -1;
+        return false;
+      }
+
+      sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      single_mmap_  = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (single_mmap_) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+      }
+
+      sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+      if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        destroy();
+        return false;
+      }
+
+      cq_ring_ = sq_ring_;
+      if (!single_mmap_) {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+          cq_ring_ = nullptr;
+          destroy();
+          return false;
+        }
+      }
+
+      sqes_size_  = params.sq_entries * sizeof(io_uring_sqe);
+      void* sqes  = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+      if (sqes == MAP_FAILED) {
+        destroy();
+        return false;
+      }
+
+      char* sq    = static_cast<char*>(sq_ring_);
+      char* cq    = static_cast<char*>(cq_ring_);
+      sq_head_    = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+      sq_tail_    = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sq_mask_    = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sq_entries_ = params.sq_entries;
+      cq_head_    = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cq_tail_    = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cq_mask_    = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes_       = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+      sqes_       = static_cast<io_uring_sqe*>(sqes);
+
+      // identity mapping, sqes are consumed in ring order
+      unsigned* sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      for (unsigned i = 0; i < sq_entries_; i++) {
+        sq_array[i] = i;
+      }
+
+      sqe_tail_ = *sq_tail_;
+      return true;
+    }
+
+    // the ring goes first, the memory its ops may still point at is unmapped and freed after that
+    void destroy() {
+      if (ring_fd_ != -1) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+      }
+
+      if (buf_ring_ != nullptr) {
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+      }
+
+      delete[] buf_base_;
+      buf_base_ = nullptr;
+
+      if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+      }
+
+      if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+      }
+      cq_ring_ = nullptr;
+
+      if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+      }
+    }
+
+    bool is_valid() const { return ring_fd_ != -1; }
+
+    // register count buffers of buf_size bytes as buffer group bgid
+    bool setup_buffer_ring(unsigned count, unsigned buf_size, uint16_t bgid) {
+      buf_ring_size_  = count * sizeof(io_uring_buf);
+      void* ring      = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (ring == MAP_FAILED) {
+        return false;
+      }
+
+      io_uring_buf_reg reg  = {};
+      reg.ring_addr         = reinterpret_cast<uint64_t>(ring);
+      reg.ring_entries      = count;
+      reg.bgid              = bgid;
+      if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ring, buf_ring_size_);
+        return false;
+      }
+
+      buf_ring_   = static_cast<io_uring_buf_ring*>(ring);
+      buf_mask_   = count - 1;
+      buf_size_   = buf_size;
+      buf_base_   = new char[static_cast<size_t>(count) * buf_size];
+      for (unsigned i = 0; i < count; i++) {
+        recycle_buffer(static_cast<uint16_t>(i));
+      }
+
+      return true;
+    }
+
+    char* buffer(uint16_t bid) const { return buf_base_ + static_cast<size_t>(bid) * buf_size_; }
+
+    // hand a consumed buffer back to the kernel
+    void recycle_buffer(uint16_t bid) {
+      // index the ring by hand, the flexible array of io_uring_buf_ring gets a different offset in C++
+      io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(buf_ring_) + (buf_tail_ & buf_mask_);
+      buf->addr         = reinterpret_cast<uint64_t>(buffer(bid));
+      buf->len          = buf_size_;
+      buf->bid          = bid;
+      buf_tail_++;
+      __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+    }
+
+    // returns a zeroed sqe, submits pending entries first when the queue is full
+    io_uring_sqe* get_sqe() {
+      if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        enter(0, 0);
+        if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+          return nullptr;
+        }
+      }
+
+      io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+      sqe_tail_++;
+      memset(sqe, 0, sizeof(io_uring_sqe));
+      return sqe;
+    }
+
+    // submit every prepared sqe and wait for at least wait_nr completions, -1 waits forever
+    int enter(unsigned wait_nr, int timeout_ms) {
+      __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+      unsigned to_submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+      }
+
+      unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+      if (wait_nr > 0 && timeout_ms >= 0) {
+        __kernel_timespec       ts  = {};
+        ts.tv_sec                   = timeout_ms / 1000;
+        ts.tv_nsec                  = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        io_uring_getevents_arg  arg = {};
+        arg.sigmask_sz              = _NSIG / 8;
+        arg.ts                      = reinterpret_cast<uint64_t>(&ts);
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr,
+                                        flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+      }
+
+      return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, nullptr, 0));
+    }
+
+    bool has_completions() const {
+      return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    }
+
+    // copy each completion out and release its slot before invoking handler,
+    // so handler is free to prepare new submissions
+    template <typename Handler>
+    void reap(Handler&& handler) {
+      unsigned head = *cq_head_;
+      while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        io_uring_cqe cqe = cqes_[head & cq_mask_];
+        head++;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        handler(cqe);
+      }
+    }
+  private:
+    int                 ring_fd_        = -1;
+    bool                single_mmap_    = false;
+    void*               sq_ring_        = nullptr;
+    void*               cq_ring_        = nullptr;
+    size_t              sq_ring_size_   = 0;
+    size_t              cq_ring_size_   = 0;
+    size_t              sqes_size_      = 0;
+
+    unsigned*           sq_head_        = nullptr;
+    unsigned*           sq_tail_        = nullptr;
+    unsigned            sq_mask_        = 0;
+    unsigned            sq_entries_     = 0;
+    unsigned            sqe_tail_       = 0;
+    io_uring_sqe*       sqes_           = nullptr;
+
+    unsigned*           cq_head_        = nullptr;
+    unsigned*           cq_tail_        = nullptr;
+    unsigned            cq_mask_        = 0;
+    io_uring_cqe*       cqes_           = nullptr;
+
+    io_uring_buf_ring*  buf_ring_       = nullptr;
+    size_t              buf_ring_size_  = 0;
+    uint16_t            buf_tail_       = 0;
+    unsigned            buf_mask_       = 0;
+    unsigned            buf_size_       = 0;
+    char*               buf_base_       = nullptr;
+  };
+
+  // io_uring backend, selected at compile time with COXNET_USE_IO_URING. Accepts and receives are
+  // multishot (one submission keeps producing completions, recv data lands in provided buffers), and
+  // all sends queued during one loop iteration are submitted together with the next wait.
+  class Poller : public IPoller {
+  public:
+    Poller() {
+      bool ok = ring_.init(uring_queue_depth) && ring_.setup_buffer_ring(uring_buffer_count, uring_buffer_size, buffer_group_);
+      assert(ok && "io_uring is not available");
+
+      wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      assert(wakeup_fd_ != -1);
+      if (ok) { _arm_wakeup(); }
+    }
+
+    // the sockets are left to ~IPoller, the ring goes first so none of them is still referenced by an op
+    ~Poller() override {
+      udp_sockets_.release(true);
+      ring_.destroy();
+      _delete_listener();
+      if (wakeup_fd_ != -1) { close(wakeup_fd_); }
+    }
+
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+    Poller(Poller&& other) = delete;
+    Poller& operator=(Poller&& other) = delete;
+
+    Socket* connect(const char address[], const uint16_t port, DataCallback on_data, CloseCallback on_close) override {
+      if (!ring_.is_valid()) { return nullptr; }
+
+      socket_t sock_handle = open_connect_socket(address, port);
+      if (sock_handle == invalid_socket) {
+        return nullptr;
+      }
+
+      auto conn = _new_socket(sock_handle, _cleaner(), -1, this);
+      conn->_set_remote_addr(address, port);
+      if (!_add_conn(conn)) {
+        _discard_conn(conn);
+        return nullptr;
+      }
+      _arm_recv(conn);
+
+      if (on_data != nullptr || on_close != nullptr) { conn->set_callbacks(std::move(on_data), std::move(on_close)); }
+
+      return conn;
+    }
+
+    Socket* async_connect(const char address[], const uint16_t port, ConnectCallback on_connect,
+                          DataCallback on_data = nullptr, CloseCallback on_close = nullptr,
+                          uint32_t timeout_ms = default_connect_timeout_ms) override {
+      if (!ring_.is_valid()) { return nullptr; }
+
+      socket_t sock_handle = open_async_connect_socket(address, port);
+      if (sock_handle == invalid_socket) {
+        return nullptr;
+      }
+
+      // the socket turns writable when the handshake is done, either way
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) {
+        ::close(sock_handle);
+        return nullptr;
+      }
+
+      auto conn = _new_socket(sock_handle, _cleaner(), -1, this);
+      conn->_set_remote_addr(address, port);
+      if (!_begin_connect(conn, std::move(on_connect), std::move(on_data), std::move(on_close), timeout_ms)) {
+        // the sqe is taken already, it goes out as a no-op
+        sqe->opcode     = IORING_OP_NOP;
+        sqe->user_data  = _user_data(nullptr, kCancel);
+        _discard_conn(conn);
+        return nullptr;
+      }
+
+      sqe->opcode         = IORING_OP_POLL_ADD;
+      sqe->fd             = sock_handle;
+      sqe->poll32_events  = POLLOUT;
+      sqe->user_data      = _user_data(conn, kConnect);
+      conn->uring_ops_++;
+      return conn;
+    }
+
+    bool listen(const char address[], uint16_t port, ProtocolStack stack,
+                ConnectionCallback on_connection, DataCallback on_data, CloseCallback on_close) override {
+      if (sock_listener_ != nullptr || !ring_.is_valid()) {
+        return false;
+      }
+
+      socket_t sock_handle = open_listen_socket(address, port, stack, reuse_port_);
+      if (sock_handle == invalid_socket) { return false; }
+
+      sock_listener_ = new listener(sock_handle, address);
+      _arm_accept();
+
+      on_connection_  = std::move(on_connection);
+      on_data_        = std::move(on_data);
+      on_close_       = std::move(on_close);
+
+      return true;
+    }
+
+    // the multishot accept is cancelled, a completion still on its way belongs to a past listen round
+    void unlisten() override {
+      if (sock_listener_ == nullptr) { return; }
+
+      _cancel(_accept_user_data());
+      listen_round_++;
+      accept_pending_ = false;
+      _delete_listener();
+    }
+
+    // a UDP socket bound to address:port, every recvmmsg batch goes to on_datagrams. A multishot
+    // poll reports readability, the datagrams themselves are read with recvmmsg. Released by
+    // UdpSocket::close() or shut()
+    UdpSocket* bind_udp(const char address[], uint16_t port, DatagramCallback on_datagrams) {
+      if (!ring_.is_valid()) { return nullptr; }
+
+      socket_t sock_handle = open_udp_socket(address, port, reuse_port_);
+      if (sock_handle == invalid_socket) { return nullptr; }
+
+      auto udp = new UdpSocket(sock_handle, this, std::move(on_datagrams));
+      if (!_arm_udp(udp)) {
+        delete udp;
+        return nullptr;
+      }
+
+      udp_sockets_.add(udp);
+      return udp;
+    }
+
+    void poll(int timeout_ms = 0) override { _poll(timeout_ms, _function_callbacks()); }
+
+    void wakeup() override {
+      if (wakeup_fd_ == -1) { return; }
+
+      // one pending notification is enough, skip the syscall while the poller has not consumed it yet
+      if (wakeup_pending_.exchange(true)) { return; }
+
+      uint64_t one = 1;
+      [[maybe_unused]] ssize_t n = ::write(wakeup_fd_, &one, sizeof(one));
+    }
+
+    void shut() override { _shut(_function_callbacks()); }
+  protected:
+    // poll() and shut() with the user callbacks bound at compile time, see IPoller::FunctionCallbacks
+    template <typename Callbacks>
+    void _poll(int timeout_ms, const Callbacks& callbacks) {
+      if (!ring_.is_valid()) { return; }
+      if (shutdown_requested_.load()) { return; }
+
+      _enter_loop();
+      metrics_.on_loop_begin();
+      _poll_once(_timer_timeout(timeout_ms), callbacks);
+      _run_timers();
+      _run_tasks();
+      _dispatch_resumed(callbacks);
+      _flush_pending_writes();
+      udp_sockets_.flush();
+      _cleanup(callbacks);
+      udp_sockets_.release();
+      metrics_.on_loop_end();
+    }
+
+    template <typename Callbacks>
+    void _shut(const Callbacks& callbacks) {
+      _delete_listener();
+      IPoller::_drop_pending_writes();
+
+      // in-flight sends still read the write chains, nothing may be released before the ring let go of them
+      for (const auto& [handle, conn] : conns_) {
+        conn->_close_handle();
+      }
+      udp_sockets_.close_all();
+      _drain_ring(callbacks);
+
+      // ops that outlived the drain die with the ring, only then are the sockets they point at released
+      ring_.destroy();
+      IPoller::_close_conns_internal(callbacks);
+      udp_sockets_.release(true);
+
+      if (wakeup_fd_ != -1) {
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+      }
+    }
+
+    template <typename Callbacks>
+    void _poll_once(int timeout_ms, const Callbacks& callbacks) {
+      _retry_deferred();
+      _prepare_sends();
+      if (accept_pending_) { _arm_accept(); }
+
+      // completions left from the previous round must not wait for new ones, neither do submissions
+      // that are still waiting for room in the submission queue
+      unsigned wait_nr = (timeout_ms != 0 && !ring_.has_completions() && !_has_deferred()) ? 1 : 0;
+      metrics_.on_wait_begin();
+      ring_.enter(wait_nr, timeout_ms);
+      metrics_.on_wait_end();
+
+      size_t events = 0;
+      ring_.reap([this, &events, &callbacks](const io_uring_cqe& cqe) {
+        events++;
+        _handle_completion(cqe, callbacks);
+      });
+      metrics_.on_events(events);
+    }
+  private:
+    friend class Socket;
+
+    enum UringOp : uint64_t { kWakeup = 0, kAccept = 1, kRecv = 2, kSend = 3, kConnect = 4, kCancel = 5, kWritable = 6, kUdp = 7 };
+    static constexpr uint64_t op_mask = 0x7;
+
+    static uint64_t _user_data(void* ptr, UringOp op) { return reinterpret_cast<uint64_t>(ptr) | op; }
+
+    // accepts carry the listen round instead of a pointer, see unlisten()
+    uint64_t _accept_user_data() const { return (listen_round_ << 3) | kAccept; }
+
+    // cancel every op and reap the completions until no socket is referenced by the ring anymore,
+    // sockets are closed by then so their handlers do not re-arm anything
+    template <typename Callbacks>
+    void _drain_ring(const Callbacks& callbacks) {
+      if (!ring_.is_valid()) { return; }
+
+      // the queued sends of closed sockets are only dropped, which releases their op count, and so
+      // are submissions still waiting for room
+      _prepare_sends();
+      for (Socket* conn : deferred_recvs_) {
+        conn->uring_ops_--;
+      }
+      deferred_recvs_.clear();
+      deferred_cancels_.clear();
+
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe != nullptr) {
+        sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+        sqe->fd           = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data    = _user_data(nullptr, kCancel);
+      }
+
+      const uint64_t deadline = TimerWheel::now_ms() + uring_drain_timeout_ms;
+      while (_ops_in_flight() && TimerWheel::now_ms() < deadline) {
+        ring_.enter(1, 10);
+        ring_.reap([this, &callbacks](const io_uring_cqe& cqe) { _handle_completion(cqe, callbacks); });
+      }
+    }
+
+    bool _ops_in_flight() const {
+      for (const auto& [handle, conn] : conns_) {
+        if (conn->_io_pending()) { return true; }
+      }
+      return false;
+    }
+
+    // a queued send counts as in flight, the socket must not be released before _prepare_sends saw it
+    void _queue_send(Socket* conn) {
+      conn->uring_ops_++;
+      send_queue_.emplace_back(conn);
+    }
+
+    void _arm_wakeup() {
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) { return; }
+
+      sqe->opcode     = IORING_OP_READ;
+      sqe->fd         = wakeup_fd_;
+      sqe->addr       = reinterpret_cast<uint64_t>(&wakeup_value_);
+      sqe->len        = sizeof(wakeup_value_);
+      sqe->user_data  = _user_data(nullptr, kWakeup);
+    }
+
+    // with no room in the submission queue the re-arm is retried by _poll_once, a listener whose
+    // multishot accept ended must not stop accepting for good
+    void _arm_accept() {
+      accept_pending_ = false;
+      if (sock_listener_ == nullptr || !sock_listener_->is_valid()) { return; }
+
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) {
+        accept_pending_ = true;
+        return;
+      }
+
+      sqe->opcode       = IORING_OP_ACCEPT;
+      sqe->fd           = sock_listener_->native_handle();
+      sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+      sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+      sqe->user_data    = _accept_user_data();
+    }
+
+    // counts as armed while it waits for a free sqe, the wait pins the socket like the op itself
+    void _arm_recv(Socket* conn) {
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) {
+        conn->uring_ops_++;
+        conn->recv_armed_ = true;
+        deferred_recvs_.emplace_back(conn);
+        return;
+      }
+
+      sqe->opcode     = IORING_OP_RECV;
+      sqe->fd         = conn->native_handle();
+      sqe->ioprio     = IORING_RECV_MULTISHOT;
+      sqe->flags      = IOSQE_BUFFER_SELECT;
+      sqe->buf_group  = buffer_group_;
+      sqe->user_data  = _user_data(conn, kRecv);
+      conn->uring_ops_++;
+      conn->recv_armed_ = true;
+    }
+
+    // the multishot recv ends with -ECANCELED, data completed before that is buffered while paused
+    void _cancel_recv(Socket* conn) { _cancel(_user_data(conn, kRecv)); }
+
+    // cancel the op submitted with user_data, retried next round when the submission queue is full
+    void _cancel(uint64_t user_data) {
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) {
+        deferred_cancels_.emplace_back(user_data);
+        return;
+      }
+
+      sqe->opcode     = IORING_OP_ASYNC_CANCEL;
+      sqe->fd         = -1;
+      sqe->addr       = user_data;
+      sqe->user_data  = _user_data(nullptr, kCancel);
+    }
+
+    // submissions that found the queue full earlier, a recv is only armed if still wanted by then
+    void _retry_deferred() {
+      if (!deferred_recvs_.empty()) {
+        retrying_recvs_.swap(deferred_recvs_);
+        for (Socket* conn : retrying_recvs_) {
+          conn->uring_ops_--;
+          conn->recv_armed_ = false;
+          if (conn->is_valid() && !conn->reading_paused_) { _arm_recv(conn); }
+        }
+        retrying_recvs_.clear();
+      }
+
+      if (!deferred_cancels_.empty()) {
+        retrying_cancels_.swap(deferred_cancels_);
+        for (uint64_t user_data : retrying_cancels_) {
+          _cancel(user_data);
+        }
+        retrying_cancels_.clear();
+      }
+    }
+
+    bool _has_deferred() const {
+      return accept_pending_ || !send_queue_.empty() || !deferred_recvs_.empty() || !deferred_cancels_.empty() ||
+             !resumed_.empty();
+    }
+
+    void _update_reading(Socket* conn) {
+      if (conn->reading_paused_) {
+        if (conn->recv_armed_) { _cancel_recv(conn); }
+        return;
+      }
+
+      if (!conn->recv_armed_) { _arm_recv(conn); }
+
+      // what was buffered while paused is handed over from the loop, not from inside the caller's callback
+      if (conn->read_buff_->written_size() > 0) { resumed_.emplace_back(conn->id()); }
+    }
+
+    template <typename Callbacks>
+    void _dispatch_resumed(const Callbacks& callbacks) {
+      if (resumed_.empty()) { return; }
+
+      dispatching_.swap(resumed_);
+      for (ConnId id : dispatching_) {
+        Socket* conn = find(id);
+        if (conn != nullptr && conn->is_valid() && !conn->reading_paused_ && conn->read_buff_->written_size() > 0) {
+          _dispatch_read(conn, callbacks);
+        }
+      }
+      dispatching_.clear();
+    }
+
+    // one sendmsg per queued socket gathering its whole chain, new writes are appended behind
+    // the in flight bytes and go out with the next send. msghdr/iovec only have to live until
+    // the submission, the kernel copies them (IORING_FEAT_SUBMIT_STABLE)
+    void _prepare_sends() {
+      if (send_queue_.empty()) { return; }
+
+      // callbacks run from here (send_file completions, watermarks) may queue sockets again, those
+      // go to send_queue_ and wait for the next round, the batch and its msghdr/iovec slots stay fixed
+      sending_.swap(send_queue_);
+      const size_t count    = sending_.size();
+      bool         sq_full  = false;
+      send_msgs_.resize(count);
+      send_iovs_.resize(count * max_iov_per_write);
+      for (size_t i = 0; i < count; i++) {
+        Socket* conn = sending_[i];
+        // sends of a dial wait for the handshake, _resume_after_connect queues them again
+        if (!conn->is_valid() || conn->send_inflight_ || conn->connecting_) {
+          conn->uring_ops_--;
+          continue;
+        }
+
+        if (conn->write_buff_->empty()) {
+          conn->wait_writable_ = false;
+          conn->uring_ops_--;
+          continue;
+        }
+
+        // no room in the submission queue, the socket keeps its queued op and is retried next round
+        if (sq_full) {
+          send_queue_.emplace_back(conn);
+          continue;
+        }
+
+        if (conn->write_buff_->front_is_file() && !_send_files(conn)) { continue; }
+
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (sqe == nullptr) {
+          sq_full = true;
+          send_queue_.emplace_back(conn);
+          continue;
+        }
+
+        msghdr* msg     = &send_msgs_[i];
+        *msg            = {};
+        msg->msg_iov    = &send_iovs_[i * max_iov_per_write];
+        msg->msg_iovlen = conn->write_buff_->fill(msg->msg_iov, max_iov_per_write);
+
+        sqe->opcode     = IORING_OP_SENDMSG;
+        sqe->fd         = conn->native_handle();
+        sqe->addr       = reinterpret_cast<uint64_t>(msg);
+        sqe->len        = 1;
+        sqe->msg_flags  = send_flags;
+        sqe->user_data  = _user_data(conn, kSend);
+        conn->send_inflight_ = true;
+      }
+      sending_.clear();
+    }
+
+    // file ranges at the front go out with a plain sendfile, no ring op moves page cache to a socket
+    // without a pipe. false when nothing is left for a sendmsg: waiting for POLLOUT, closed or drained
+    bool _send_files(Socket* conn) {
+      while (conn->write_buff_->front_is_file()) {
+        bool  zerocopy  = false;
+        int   sent_n    = conn->_send_front(zerocopy);
+        if (sent_n > 0) {
+          metrics_.on_write(static_cast<size_t>(sent_n));
+          conn->write_buff_->consume(static_cast<size_t>(sent_n));
+          conn->_check_low_watermark();
+          if (!conn->is_valid()) {
+            conn->uring_ops_--;
+            return false;
+          }
+          continue;
+        }
+
+        const int   err_code  = get_last_error();
+        ErrorAction action    = handle_error_action(err_code);
+        if (action == ErrorAction::kContinue) { continue; }
+        if (action == ErrorAction::kRetry) {
+          metrics_.on_write_again();
+          _arm_writable(conn);
+          return false;
+        }
+
+        conn->uring_ops_--;
+        conn->_close_handle(err_code);
+        return false;
+      }
+
+      if (conn->write_buff_->empty()) {
+        conn->wait_writable_ = false;
+        conn->uring_ops_--;
+        return false;
+      }
+      return true;
+    }
+
+    // the queued send op carries over to the poll, its completion queues the socket again. Without a
+    // free sqe the socket is queued once more and tries the sendfile again next round
+    void _arm_writable(Socket* conn) {
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) {
+        send_queue_.emplace_back(conn);
+        return;
+      }
+
+      sqe->opcode         = IORING_OP_POLL_ADD;
+      sqe->fd             = conn->native_handle();
+      sqe->poll32_events  = POLLOUT;
+      sqe->user_data      = _user_data(conn, kWritable);
+      conn->send_inflight_ = true;
+    }
+
+    bool _arm_udp(UdpSocket* udp) {
+      io_uring_sqe* sqe = ring_.get_sqe();
+      if (sqe == nullptr) { return false; }
+
+      sqe->opcode         = IORING_OP_POLL_ADD;
+      sqe->fd             = udp->native_handle();
+      sqe->len            = IORING_POLL_ADD_MULTI;
+      sqe->poll32_events  = POLLIN;
+      sqe->user_data      = _user_data(udp, kUdp);
+      udp->ops_++;
+      return true;
+    }
+
+    void _on_udp(UdpSocket* udp, int res, bool more) {
+      if (!more) { udp->ops_--; }
+      if (!udp->is_valid()) { return; }
+
+      if (res > 0) { udp->_read_batches(); }
+      if (!more && udp->is_valid() && !_arm_udp(udp)) { udp->close(); }
+    }
+
+    void _on_writable(Socket* conn) {
+      conn->send_inflight_ = false;
+      conn->uring_ops_--;
+      if (conn->is_valid()) { _queue_send(conn); }
+    }
+
+    template <typename Callbacks>
+    void _handle_completion(const io_uring_cqe& cqe, const Callbacks& callbacks) {
+      auto  op    = static_cast<UringOp>(cqe.user_data & op_mask);
+      void* ptr   = reinterpret_cast<void*>(cqe.user_data & ~op_mask);
+      bool  more  = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+      switch (op) {
+      case kWakeup:
+        wakeup_pending_.store(false);
+        if (wakeup_fd_ != -1) { _arm_wakeup(); }
+        break;
+      case kAccept:
+        _on_accept(cqe.user_data, cqe.res, more, callbacks);
+        break;
+      case kRecv:
+        _on_recv(static_cast<Socket*>(ptr), cqe, more, callbacks);
+        break;
+      case kSend:
+        _on_send(static_cast<Socket*>(ptr), cqe.res);
+        break;
+      case kConnect:
+        _on_connect(static_cast<Socket*>(ptr), cqe.res);
+        break;
+      case kWritable:
+        _on_writable(static_cast<Socket*>(ptr));
+        break;
+      case kUdp:
+        _on_udp(static_cast<UdpSocket*>(ptr), cqe.res, more);
+        break;
+      default:
+        break;
+      }
+    }
+
+    template <typename Callbacks>
+    void _on_accept(uint64_t user_data, int res, bool more, const Callbacks& callbacks) {
+      if (user_data != _accept_user_data() || sock_listener_ == nullptr || !sock_listener_->is_valid()) {
+        if (res >= 0) { ::close(res); }
+        return;
+      }
+
+      if (res >= 0) {
+        sockaddr_storage  remote_addr_storage = {};
+        socklen_t         addr_len            = sizeof(remote_addr_storage);
+        char              client_ip_str[INET6_ADDRSTRLEN] = { 0 };
+        uint16_t          client_port         = 0;
+        if (getpeername(res, reinterpret_cast<sockaddr*>(&remote_addr_storage), &addr_len) == 0) {
+          address_to_string(remote_addr_storage, client_ip_str, client_port);
+        }
+
+        auto conn = _new_socket(res, _cleaner(), -1, this);
+        conn->_set_remote_addr(client_ip_str, client_port);
+        if (_add_conn(conn)) {
+          metrics_.on_accept();
+          _arm_recv(conn);
+          _notify_connection(conn, callbacks);
+        } else {
+          metrics_.on_accept_failure();
+          _discard_conn(conn);
+        }
+      } else {
+        int         err_code  = -res;
+        ErrorAction action    = handle_error_action(err_code);
+        metrics_.on_accept_failure();
+        if (action == ErrorAction::kClose) {
+          sock_listener_->_close_handle(err_code);
+          if (on_listen_err_ != nullptr) { on_listen_err_(err_code); }
+
+          request_shutdown();
+          return;
+        }
+      }
+
+      // multishot ends on errors or CQ overflow, re-arm it
+      if (!more) { _arm_accept(); }
+    }
+
+    void _on_connect(Socket* conn, int res) {
+      conn->uring_ops_--;
+      if (!conn->is_valid()) { return; }
+
+      _complete_connect(conn, res < 0 ? -res : connect_result(conn->native_handle()));
+      if (conn->is_valid()) { _arm_recv(conn); }
+    }
+
+    template <typename Callbacks>
+    void _on_recv(Socket* conn, const io_uring_cqe& cqe, bool more, const Callbacks& callbacks) {
+      if (!more) {
+        conn->uring_ops_--;
+        conn->recv_armed_ = false;
+      }
+
+      if (cqe.res > 0) {
+        metrics_.on_read(static_cast<size_t>(cqe.res));
+        uint16_t  bid   = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        char*     data  = ring_.buffer(bid);
+        if (conn->is_valid()) {
+          _deliver(conn, data, static_cast<size_t>(cqe.res), callbacks);
+        }
+
+        ring_.recycle_buffer(bid);
+        if (!more && conn->is_valid() && !conn->reading_paused_) { _arm_recv(conn); }
+        return;
+      }
+
+      if (!conn->is_valid()) { return; }
+
+      // cancelled by pause_reading(), or EOF/error while paused: resume_reading() re-arms and sees it again
+      if (conn->reading_paused_ || cqe.res == -ECANCELED) {
+        if (!more && !conn->reading_paused_) { _arm_recv(conn); }
+        return;
+      }
+
+      // provided buffers ran dry, they were recycled above so just re-arm
+      if (cqe.res == -ENOBUFS) {
+        if (!more) { _arm_recv(conn); }
+        return;
+      }
+
+      // give EIO for a peer close, same as EPOLLRDHUP in the epoll poller
+      conn->_close_handle(cqe.res == 0 ? EIO : -cqe.res);
+    }
+
+    // nothing pending: hand the provided buffer to the user directly and keep only the unconsumed tail
+    template <typename Callbacks>
+    void _deliver(Socket* conn, const char* data, size_t size, const Callbacks& callbacks) {
+      SimpleBuffer* buff = conn->read_buff_;
+      if (conn->reading_paused_) {
+        conn->_on_read_activity();
+        if (!_buffer(conn, data, size)) { conn->_close_handle(ENOBUFS); }
+        return;
+      }
+
+      if (buff->written_size() > 0) {
+        if (!_buffer(conn, data, size)) {
+          conn->_close_handle(ENOBUFS);
+          return;
+        }
+        _dispatch_read(conn, callbacks);
+        return;
+      }
+
+      conn->_on_read_activity();
+      if (_consumes_reads(conn, callbacks)) {
+        size_t consumed = std::min(_notify_read(conn, data, size, callbacks), size);
+        if (consumed < size && !_buffer(conn, data + consumed, size - consumed)) { conn->_close_handle(ENOBUFS); }
+        return;
+      }
+
+      _notify_data(conn, data, size, callbacks);
+    }
+
+    // keep data in the read buffer of conn, false when it would outgrow max_read_buff_capacity
+    bool _buffer(Socket* conn, const char* data, size_t size) {
+      const size_t capacity = conn->read_buff_->capacity();
+      if (!conn->read_buff_->write(data, size)) { return false; }
+      if (conn->read_buff_->capacity() != capacity) { metrics_.on_buffer_growth(); }
+      return true;
+    }
+
+    void _on_send(Socket* conn, int res) {
+      conn->send_inflight_ = false;
+      conn->uring_ops_--;
+      if (!conn->is_valid()) { return; }
+
+      if (res < 0) {
+        if (handle_error_action(-res) == ErrorAction::kClose) {
+          conn->_close_handle(-res);
+          return;
+        }
+
+        res = 0;
+      }
+
+      if (res > 0) { metrics_.on_write(static_cast<size_t>(res)); }
+      conn->write_buff_->consume(static_cast<size_t>(res));
+      conn->_check_low_watermark();
+      if (!conn->is_valid()) { return; }
+
+      if (!conn->write_buff_->empty()) {
+        _queue_send(conn);
+        return;
+      }
+
+      conn->wait_writable_ = false;
+    }
+  private:
+    friend class UdpSocket;
+
+    UringRing             ring_;
+    std::vector<Socket*>  send_queue_;
+    std::vector<Socket*>  sending_;
+    std::vector<msghdr>   send_msgs_;
+    std::vector<iovec>    send_iovs_;
+    std::vector<Socket*>  deferred_recvs_;    // recvs waiting for a free sqe, see _retry_deferred()
+    std::vector<Socket*>  retrying_recvs_;
+    std::vector<uint64_t> deferred_cancels_;  // user_data of ops still to be cancelled
+    std::vector<uint64_t> retrying_cancels_;
+    std::vector<ConnId>   resumed_;           // resumed sockets with buffered input, see _dispatch_resumed()
+    std::vector<ConnId>   dispatching_;
+    int                   wakeup_fd_      = -1;
+    uint64_t              wakeup_value_   = 0;
+    bool                  accept_pending_ = false;  // the multishot accept still has to be re-armed
+    uint64_t              listen_round_   = 0;
+    std::atomic<bool>     wakeup_pending_ = { false };
+    UdpSockets            udp_sockets_;
+
+    static constexpr uint16_t buffer_group_ = 0;
+  };
+
+  inline void Socket::_wait_writable(bool enable) {
+    if (wait_writable_ == enable) {
+      return;
+    }
+
+    wait_writable_ = enable;
+    if (enable) {
+      static_cast<Poller*>(poller_)->_queue_send(this);
+    }
+  }
+
+  inline void UdpSocket::_unregister() {
+    auto poller = static_cast<Poller*>(poller_);
+    if (!poller->ring_.is_valid()) { return; }
+
+    io_uring_sqe* sqe = poller->ring_.get_sqe();
+    if (sqe == nullptr) { return; }
+
+    sqe->opcode     = IORING_OP_POLL_REMOVE;
+    sqe->fd         = -1;
+    sqe->addr       = Poller::_user_data(this, Poller::kUdp);
+    sqe->user_data  = Poller::_user_data(nullptr, Poller::kCancel);
+  }
+
+  inline void Socket::_update_reading() { static_cast<Poller*>(poller_)->_update_reading(this); }
+} // namespace coxnet
+
+#endif // __linux__ && COXNET_USE_IO_URING
+
+#endif // POLLER_URING_H
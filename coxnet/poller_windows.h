@@ -31,10 +31,10 @@ namespace coxnet {
     context->Conn->read_buff_->add_written_from_external_write(transferred_bytes);
   }
 
-  class Poller final : public IPoller {
+  class Poller : public IPoller {
   public:
     Poller() = default;
-    ~Poller() override = default;
+    ~Poller() override { _delete_listener(); }
 
     Poller(const Poller&) = delete;
     Poller& operator=(const Poller&) = delete;
@@ -80,7 +80,7 @@ namespace coxnet {
         return nullptr;
       }
 
-      if (!Socket::_set_non_blocking(sock_handle)) {
+      if (!set_non_blocking(sock_handle)) {
         closesocket(sock_handle);
         return nullptr;
       }
@@ -117,18 +117,33 @@ namespace coxnet {
         return nullptr;
       }
 
-      auto conn = new Socket(sock_handle, this->_cleaner());
+      auto conn = this->_new_socket(sock_handle, this->_cleaner(), -1, this);
       conn->_set_remote_addr(address, port);
-      conns_.emplace(conn->native_handle(), conn);
+      if (!_add_conn(conn)) {
+        _discard_conn(conn);
+        return nullptr;
+      }
 
-      // Set callbacks on IPoller (these are general for the poller instance)
-      on_data_  = std::move(on_data);
-      on_close_ = std::move(on_close);
+      if (on_data != nullptr || on_close != nullptr) { conn->set_callbacks(std::move(on_data), std::move(on_close)); }
 
       conn->io_completed_ = true; // IMPORTANT: trigger first async read in _poll loop
       return conn;
     }
 
+    // no ConnectEx here yet, the handshake still blocks like connect() and only the report is deferred
+    Socket* async_connect(const char address[], const uint16_t port, ConnectCallback on_connect,
+                          DataCallback on_data = nullptr, CloseCallback on_close = nullptr,
+                          uint32_t timeout_ms = default_connect_timeout_ms) override {
+      Socket* conn = connect(address, port, std::move(on_data), std::move(on_close));
+      if (conn == nullptr) { return nullptr; }
+
+      this->post([this, id = conn->id(), on_connect = std::move(on_connect)]() {
+        Socket* conn = this->find(id);
+        if (conn != nullptr && on_connect != nullptr) { on_connect(conn, 0); }
+      });
+      return conn;
+    }
+
     // Only IPv4: address is IPv4, stack is kOnlyIPv4
     // Only IPv6: address is IPv6, stack is kOnlyIPv6
     // Dual: address is IPv6, stack is kDual
@@ -221,7 +236,7 @@ namespace coxnet {
       }
 
       // Listener socket should be non-blocking for accept loop
-      if (!Socket::_set_non_blocking(sock_handle)) {
+      if (!set_non_blocking(sock_handle)) {
         closesocket(sock_handle);
         return false;
       }
@@ -235,46 +250,67 @@ namespace coxnet {
       return true;
     }
 
-    void poll() override {
-      if (shutdown_requested_.load()) { return; }
+    void unlisten() override { _delete_listener(); }
 
-      _poll_once();
-      _cleanup();
-    }
+    // completions are delivered by the IOCP thread pool and picked up by polling, so there is
+    // nothing to block on: a non-zero timeout only yields the thread for a short while
+    void poll(int timeout_ms = 0) override { _poll(timeout_ms, _function_callbacks()); }
 
-    void shut() override {
-      if (sock_listener_ != nullptr && sock_listener_->native_handle() != invalid_socket) {
-        sock_listener_->_close_handle(0);
-      }
+    void wakeup() override {}
 
-      IPoller::_close_conns_internal();
+    void shut() override { _shut(_function_callbacks()); }
+  protected:
+    // poll() and shut() with the user callbacks bound at compile time, see IPoller::FunctionCallbacks
+    template <typename Callbacks>
+    void _poll(int timeout_ms, const Callbacks& callbacks) {
+      if (shutdown_requested_.load()) { return; }
 
-      delete sock_listener_;
-      sock_listener_ = nullptr;
+      _enter_loop();
+      metrics_.on_loop_begin();
+      _poll_once(callbacks);
+      _run_timers();
+      _run_tasks();
+      _flush_pending_writes();
+      _cleanup(callbacks);
+      metrics_.on_loop_end();
+
+      if (timeout_ms != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
     }
-  protected:
-    void _poll_once() {
-      if (sock_listener_ == nullptr || !sock_listener_->is_valid()) { return; }
 
-      _accept_connections();
-      if (sock_listener_->err_ != 0 && on_listen_err_) {
-        on_listen_err_(sock_listener_->err_);
+    template <typename Callbacks>
+    void _shut(const Callbacks& callbacks) {
+      _delete_listener();
+      IPoller::_drop_pending_writes();
+      IPoller::_close_conns_internal(callbacks);
+    }
 
-        request_shutdown();
-        return;
+    template <typename Callbacks>
+    void _poll_once(const Callbacks& callbacks) {
+      if (sock_listener_ != nullptr && sock_listener_->is_valid()) {
+        _accept_connections(callbacks);
+        // a callback may have called unlisten()
+        if (sock_listener_ != nullptr && sock_listener_->err_ != 0 && on_listen_err_) {
+          on_listen_err_(sock_listener_->err_);
+
+          request_shutdown();
+          return;
+        }
       }
 
       for (auto& [handle, conn] : conns_) {
         if (!conn || !conn->is_valid()) { continue; }
 
-        _try_read(conn);
+        _try_read(conn, callbacks);
         if (!conn->is_valid()) { continue; }
 
         _try_write_async(conn);
       }
     }
   private:
-    void _accept_connections() {
+    template <typename Callbacks>
+    void _accept_connections(const Callbacks& callbacks) {
       while (sock_listener_ != nullptr && sock_listener_->is_valid()) {
         sockaddr_storage  remote_addr_storage = {}; // For IPv4/IPv6
         int               addr_len            = sizeof(remote_addr_storage);
@@ -290,7 +326,7 @@ namespace coxnet {
           break;
         }
 
-        if (!Socket::_set_non_blocking(handle)) {
+        if (!set_non_blocking(handle)) {
           closesocket(handle);
           continue;
         }
@@ -320,28 +356,35 @@ namespace coxnet {
           break;
         }
 
-        auto conn = new Socket(handle, this->_cleaner());
+        auto conn = this->_new_socket(handle, this->_cleaner(), -1, this);
         conn->_set_remote_addr(client_ip_str, client_port);
-        conns_.emplace(conn->native_handle(), conn);
-        if (on_connection_ != nullptr) {
-          on_connection_(conn);
+        if (!_add_conn(conn)) {
+          metrics_.on_accept_failure();
+          _discard_conn(conn);
+          continue;
         }
 
+        metrics_.on_accept();
+        _notify_connection(conn, callbacks);
+
         conn->io_completed_ = true; // Trigger first async read for this new connection
       }
     }
 
-    void _try_read(Socket* conn) {
-      if (!conn || !conn->is_valid() || !conn->read_buff_ || !conn->io_completed_) { return; }
+    template <typename Callbacks>
+    void _try_read(Socket* conn, const Callbacks& callbacks) {
+      if (!conn || !conn->is_valid() || !conn->read_buff_ || !conn->io_completed_ || conn->reading_paused_) { return; }
 
-      if (conn->read_buff_->written_size() > 0 && on_data_ != nullptr) {
-        on_data_(conn, conn->read_buff_->take_data(), conn->read_buff_->written_size());
+      if (conn->read_buff_->written_size() > 0) {
+        _dispatch_read(conn, callbacks);
       }
 
-      conn->io_completed_ = false;
-      conn->read_buff_->clear();
+      if (!conn->_overlapped()) {
+        conn->_close_handle(WSAENOBUFS);
+        return;
+      }
 
-      conn->_overlapped();
+      conn->io_completed_ = false;
 
       DWORD recv_bytes  = 0;
       DWORD flags       = 0;
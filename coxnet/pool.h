@@ -0,0 +1,132 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "io_def.h"
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace coxnet {
+  struct PoolStats {
+    size_t block_size = 0;
+    size_t slabs      = 0;  // slabs allocated so far, memory is kept until the pool is destroyed
+    size_t in_use     = 0;  // blocks currently handed out
+    size_t hits       = 0;  // acquires served from the free list
+    size_t misses     = 0;  // acquires that had to allocate, a new slab or a plain heap block when disabled
+  };
+
+  struct PoolConfig {
+    size_t  buffer_blocks_per_slab  = pool_blocks_per_slab;
+    size_t  socket_blocks_per_slab  = pool_blocks_per_slab;
+    bool    enabled                 = true;
+  };
+
+  // Fixed-size block allocator: blocks are carved from slabs of blocks_per_slab and recycled
+  // through an intrusive free list. Owned by one poller, not thread-safe.
+  class SlabPool {
+  public:
+    explicit SlabPool(size_t block_size, size_t blocks_per_slab = pool_blocks_per_slab)
+    : block_size_(_round_up(block_size)), blocks_per_slab_(blocks_per_slab) {
+      stats_.block_size = block_size_;
+    }
+
+    ~SlabPool() { _release_slabs(); }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    size_t block_size() const { return block_size_; }
+    bool enabled() const { return enabled_; }
+    PoolStats stats() const { return stats_; }
+
+    // whether configure() with blocks_per_slab would succeed
+    bool can_configure(size_t blocks_per_slab) const { return stats_.in_use == 0 && blocks_per_slab != 0; }
+
+    // only possible while no block is handed out, a disabled pool falls back to operator new
+    bool configure(size_t blocks_per_slab, bool enabled) {
+      if (!can_configure(blocks_per_slab)) { return false; }
+
+      _release_slabs();
+      blocks_per_slab_  = blocks_per_slab;
+      enabled_          = enabled;
+      return true;
+    }
+
+    void* acquire() {
+      stats_.in_use++;
+      if (!enabled_) {
+        stats_.misses++;
+        return ::operator new(block_size_);
+      }
+
+      if (free_list_ == nullptr) {
+        stats_.misses++;
+        _grow();
+      } else {
+        stats_.hits++;
+      }
+
+      FreeBlock* block  = free_list_;
+      free_list_        = block->next;
+      return block;
+    }
+
+    void release(void* ptr) {
+      if (ptr == nullptr) { return; }
+
+      assert(stats_.in_use > 0);
+      stats_.in_use--;
+      if (!enabled_) {
+        ::operator delete(ptr);
+        return;
+      }
+
+      auto block  = static_cast<FreeBlock*>(ptr);
+      block->next = free_list_;
+      free_list_  = block;
+    }
+  private:
+    struct FreeBlock {
+      FreeBlock* next;
+    };
+
+    static size_t _round_up(size_t size) {
+      constexpr size_t align = alignof(std::max_align_t);
+      size = size < sizeof(FreeBlock) ? sizeof(FreeBlock) : size;
+      return (size + align - 1) / align * align;
+    }
+
+    void _grow() {
+      char* slab = static_cast<char*>(::operator new(block_size_ * blocks_per_slab_));
+      slabs_.emplace_back(slab);
+      stats_.slabs++;
+
+      // link back to front so blocks are handed out in address order
+      for (size_t i = blocks_per_slab_; i > 0; i--) {
+        auto block  = reinterpret_cast<FreeBlock*>(slab + (i - 1) * block_size_);
+        block->next = free_list_;
+        free_list_  = block;
+      }
+    }
+
+    void _release_slabs() {
+      for (char* slab : slabs_) {
+        ::operator delete(slab);
+      }
+      slabs_.clear();
+      free_list_    = nullptr;
+      stats_.slabs  = 0;
+    }
+  private:
+    size_t              block_size_       = 0;
+    size_t              blocks_per_slab_  = 0;
+    bool                enabled_          = true;
+    FreeBlock*          free_list_        = nullptr;
+    std::vector<char*>  slabs_;
+    PoolStats           stats_;
+  };
+} // namespace coxnet
+
+#endif // POOL_H
@@ -0,0 +1,340 @@
+#ifndef POSIX_SOCKET_H
+#define POSIX_SOCKET_H
+
+#if defined (__linux__) || (__APPLE__)
+
+#include "io_def.h"
+
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <cstddef>
+
+// socket setup shared by the POSIX pollers (epoll and io_uring), they only differ in how I/O is driven
+namespace coxnet {
+  // fill storage from an IPv4 or IPv6 literal or a unix socket path (port unused), returns the address
+  // family or 0 when address is none of them
+  inline int make_sockaddr(const char address[], const uint16_t port, sockaddr_storage& storage, socklen_t& addr_len) {
+    IPType ip_type = ip_address_type(std::string(address));
+    memset(&storage, 0, sizeof(storage));
+
+    if (ip_type == IPType::kUnix) {
+      sockaddr_un*  addr    = reinterpret_cast<sockaddr_un*>(&storage);
+      const size_t  length  = strlen(address);
+      if (length >= sizeof(addr->sun_path)) { return 0; }
+
+      addr->sun_family = AF_UNIX;
+      memcpy(addr->sun_path, address, length);
+      // the abstract namespace starts with a NUL and its name is not terminated, the length is exact
+      if (address[0] == '@') {
+        addr->sun_path[0] = '\0';
+        addr_len          = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length);
+      } else {
+        addr_len          = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length + 1);
+      }
+      return AF_UNIX;
+    }
+
+    if (ip_type == IPType::kIPv4) {
+      sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(&storage);
+      addr->sin_family  = AF_INET;
+      addr->sin_port    = htons(port);
+      if (inet_pton(AF_INET, address, &addr->sin_addr) <= 0) { return 0; }
+
+      addr_len = sizeof(sockaddr_in);
+      return AF_INET;
+    }
+
+    if (ip_type == IPType::kIPv6) {
+      sockaddr_in6* addr6 = reinterpret_cast<sockaddr_in6*>(&storage);
+      addr6->sin6_family  = AF_INET6;
+      addr6->sin6_port    = htons(port);
+      if (inet_pton(AF_INET6, address, &addr6->sin6_addr) <= 0) { return 0; }
+
+      addr_len = sizeof(sockaddr_in6);
+      return AF_INET6;
+    }
+
+    return 0;
+  }
+
+  // starts a non-blocking connect, the handshake is usually still in progress when this returns and
+  // completes once the socket turns writable (SO_ERROR tells the outcome). invalid_socket on failure
+  inline socket_t open_async_connect_socket(const char address[], const uint16_t port) {
+    sockaddr_storage  remote_addr_storage = {};
+    socklen_t         addr_len            = 0;
+    int               af_family           = make_sockaddr(address, port, remote_addr_storage, addr_len);
+    if (af_family == 0) {
+      return invalid_socket;
+    }
+
+    socket_t sock_handle = socket(af_family, SOCK_STREAM, af_family == AF_UNIX ? 0 : IPPROTO_TCP);
+    if (sock_handle == invalid_socket) {
+      return invalid_socket;
+    }
+
+    if (!set_non_blocking(sock_handle)) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    // EINPROGRESS is mean of async operation is in progress, ignore this error code
+    int result = ::connect(sock_handle, reinterpret_cast<sockaddr*>(&remote_addr_storage), addr_len);
+    if (result == SOCKET_ERROR && get_last_error() != EINPROGRESS) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    return sock_handle;
+  }
+
+  // SO_ERROR of a socket whose non-blocking connect has finished, 0 when it is connected
+  inline int connect_result(socket_t handle) {
+    int       err_code  = 0;
+    socklen_t err_len   = sizeof(err_code);
+    if (getsockopt(handle, SOL_SOCKET, SO_ERROR, &err_code, &err_len) != 0) {
+      return get_last_error();
+    }
+    return err_code;
+  }
+
+  // returns a connected non-blocking socket, invalid_socket on failure. Blocks for up to 5 seconds
+  inline socket_t open_connect_socket(const char address[], const uint16_t port) {
+    socket_t sock_handle = open_async_connect_socket(address, port);
+    if (sock_handle == invalid_socket) {
+      return invalid_socket;
+    }
+
+    fd_set write_set;
+    FD_ZERO(&write_set);
+    FD_SET(sock_handle, &write_set);
+
+    timeval timeout{ 5, 0 };
+    // use select to ensure connect operation succeed
+    int result = select((int)(sock_handle + 1), nullptr, &write_set, nullptr, &timeout);
+    if (result != 1) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    // writable also means the handshake failed, SO_ERROR tells which
+    if (connect_result(sock_handle) != 0) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    return sock_handle;
+  }
+
+  // a socket file nobody accepts on anymore is left behind by a crashed server, a live one is kept.
+  // The probe never blocks for longer than unix_probe_timeout_ms, a listener with a full backlog is live
+  inline void remove_stale_unix_socket(const sockaddr_un& addr, socklen_t addr_len) {
+    struct stat info = {};
+    if (addr.sun_path[0] == '\0' || ::stat(addr.sun_path, &info) != 0 || !S_ISSOCK(info.st_mode)) { return; }
+
+    socket_t probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe == invalid_socket) { return; }
+
+    int err_code = 0;
+    if (!set_non_blocking(probe)) {
+      err_code = get_last_error();
+    } else if (::connect(probe, reinterpret_cast<const sockaddr*>(&addr), addr_len) == SOCKET_ERROR) {
+      err_code = get_last_error();
+      if (err_code == EINPROGRESS) {
+        pollfd pfd  = {};
+        pfd.fd      = probe;
+        pfd.events  = POLLOUT;
+        err_code    = ::poll(&pfd, 1, unix_probe_timeout_ms) == 1 ? connect_result(probe) : ETIMEDOUT;
+      }
+    }
+
+    if (err_code == ECONNREFUSED) { ::unlink(addr.sun_path); }
+    ::close(probe);
+  }
+
+  // unix sockets ignore the protocol stack. A path is bound by one socket only, so reuse_port is refused
+  // with EINVAL instead of leaving the caller with a listener that shares nothing
+  inline socket_t open_unix_listen_socket(const char address[], bool reuse_port) {
+    if (reuse_port) {
+      errno = EINVAL;
+      return invalid_socket;
+    }
+
+    sockaddr_storage  local_addr_storage  = {};
+    socklen_t         addr_len            = 0;
+    if (make_sockaddr(address, 0, local_addr_storage, addr_len) != AF_UNIX) { return invalid_socket; }
+
+    const sockaddr_un& local_addr = reinterpret_cast<const sockaddr_un&>(local_addr_storage);
+    remove_stale_unix_socket(local_addr, addr_len);
+
+    socket_t sock_handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock_handle == invalid_socket) { return invalid_socket; }
+
+    if (::bind(sock_handle, reinterpret_cast<const sockaddr*>(&local_addr), addr_len) == SOCKET_ERROR ||
+        ::listen(sock_handle, SOMAXCONN) == SOCKET_ERROR || !set_non_blocking(sock_handle)) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    return sock_handle;
+  }
+
+  // returns a bound, listening, non-blocking socket, invalid_socket on failure
+  inline socket_t open_listen_socket(const char address[], uint16_t port, ProtocolStack stack, bool reuse_port) {
+    IPType ip_type = ip_address_type(std::string(address));
+    if (ip_type == IPType::kInvalid) {
+      return invalid_socket;
+    }
+
+    if (ip_type == IPType::kUnix) {
+      return open_unix_listen_socket(address, reuse_port);
+    }
+
+    int af_family = 0;
+    int dual_mode = 0;
+    if (ip_type == IPType::kIPv4 && stack == ProtocolStack::kOnlyIPv4) {
+      af_family = AF_INET;
+    }
+
+    if (ip_type == IPType::kIPv6 && stack == ProtocolStack::kOnlyIPv6) {
+      af_family = AF_INET6;
+    }
+
+    // for dual stack: supports both IPv4 and IPv6 simultaneously
+    if (ip_type == IPType::kIPv6 && stack == ProtocolStack::kDualStack) {
+      af_family = AF_INET6;
+      dual_mode = 1;
+    }
+
+    if (af_family == 0) { return invalid_socket; }
+
+    sockaddr_storage  local_addr_storage  = {};
+    socklen_t         addr_len            = 0;
+    memset(&local_addr_storage, 0, sizeof(local_addr_storage));
+
+    if (af_family == AF_INET) {
+      sockaddr_in* local_addr   = reinterpret_cast<sockaddr_in*>(&local_addr_storage);
+      local_addr->sin_family    = AF_INET;
+      local_addr->sin_port      = htons(port);
+      if (inet_pton(AF_INET, address, &local_addr->sin_addr) <= 0) { return invalid_socket; }
+      addr_len = sizeof(sockaddr_in);
+    }
+
+    if (af_family == AF_INET6) {
+      sockaddr_in6* local_addr6 = reinterpret_cast<sockaddr_in6*>(&local_addr_storage);
+      local_addr6->sin6_family  = AF_INET6;
+      local_addr6->sin6_port    = htons(port);
+      if (inet_pton(AF_INET6, address, &local_addr6->sin6_addr) <= 0) { return invalid_socket; }
+      addr_len = sizeof(sockaddr_in6);
+    }
+
+    socket_t sock_handle = ::socket(af_family, SOCK_STREAM, IPPROTO_TCP); // Use IPPROTO_TCP for stream
+    if (sock_handle == invalid_socket) { return invalid_socket; }
+
+    int reuse_addr = 1;
+    if (::setsockopt(sock_handle, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr)) == SOCKET_ERROR) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    // every poller of a PollerGroup binds its own listener, kernel balances accepts between them
+    if (reuse_port) {
+      int reuse_port_option = 1;
+      if (::setsockopt(sock_handle, SOL_SOCKET, SO_REUSEPORT, &reuse_port_option, sizeof(reuse_port_option)) == SOCKET_ERROR) {
+        ::close(sock_handle);
+        return invalid_socket;
+      }
+    }
+
+    // for dual protocol stack
+    if (af_family == AF_INET6 && dual_mode == 1) {
+      int ipv6_only = 0;
+      if (::setsockopt(sock_handle, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6_only, sizeof(ipv6_only)) == SOCKET_ERROR) {
+        if (ipv6_only == 0) {
+          ::close(sock_handle);
+          return invalid_socket;
+        }
+      }
+    }
+
+    if (::bind(sock_handle, reinterpret_cast<sockaddr*>(&local_addr_storage), addr_len) == SOCKET_ERROR) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    if (::listen(sock_handle, SOMAXCONN) == SOCKET_ERROR) { // Use SOMAXCONN for backlog
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    if (!set_non_blocking(sock_handle)) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    return sock_handle;
+  }
+
+  // returns a bound non-blocking UDP socket, invalid_socket on failure
+  inline socket_t open_udp_socket(const char address[], uint16_t port, bool reuse_port) {
+    sockaddr_storage  local_addr_storage  = {};
+    socklen_t         addr_len            = 0;
+    int               af_family           = make_sockaddr(address, port, local_addr_storage, addr_len);
+    if (af_family != AF_INET && af_family != AF_INET6) { return invalid_socket; }
+
+    socket_t sock_handle = ::socket(af_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock_handle == invalid_socket) { return invalid_socket; }
+
+    if (!set_non_blocking(sock_handle)) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    // several pollers may bind the same port, the kernel spreads datagrams by their 4-tuple
+    int option = 1;
+    if (reuse_port && ::setsockopt(sock_handle, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option)) == SOCKET_ERROR) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    if (::bind(sock_handle, reinterpret_cast<sockaddr*>(&local_addr_storage), addr_len) == SOCKET_ERROR) {
+      ::close(sock_handle);
+      return invalid_socket;
+    }
+
+    return sock_handle;
+  }
+
+  inline void address_to_string(const sockaddr_storage& addr_storage, char (&ip_str)[INET6_ADDRSTRLEN], uint16_t& port) {
+    switch (addr_storage.ss_family) {
+    case AF_INET: {
+      const sockaddr_in* sin = reinterpret_cast<const sockaddr_in*>(&addr_storage);
+      inet_ntop(AF_INET, &sin->sin_addr, ip_str, INET6_ADDRSTRLEN);
+      port = ntohs(sin->sin_port);
+      break;
+    }
+    case AF_INET6: {
+      const sockaddr_in6* sin6 = reinterpret_cast<const sockaddr_in6*>(&addr_storage);
+      inet_ntop(AF_INET6, &sin6->sin6_addr, ip_str, INET6_ADDRSTRLEN);
+      port = ntohs(sin6->sin6_port);
+      break;
+    }
+    case AF_UNIX: {
+      // peers that connect without binding are unnamed and abstract names start with a NUL, both read as empty
+      const sockaddr_un* sun = reinterpret_cast<const sockaddr_un*>(&addr_storage);
+      strncpy(ip_str, sun->sun_path, INET6_ADDRSTRLEN - 1);
+      ip_str[INET6_ADDRSTRLEN - 1] = '\0';
+      port = 0;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+} // namespace coxnet
+
+#endif // __linux__ || __APPLE__
+
+#endif // POSIX_SOCKET_H
@@ -4,35 +4,82 @@
 #include "poller.h"
 #include "buffer.h"
 #include "io_def.h"
+#include "timer_wheel.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <initializer_list>
 #include <memory>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
 #include <utility>
-#include <set>
+#include <vector>
 
 namespace coxnet {
+  class IPoller;
+
+  // Deferred destruction of closed sockets. A socket is queued once when it is closed and released
+  // on the poller's next cleanup, after the event batch that may still reference it is done, so the
+  // work per tick is proportional to the sockets closed in that tick.
   class Cleaner {
   public:
-    Cleaner(std::function<void(socket_t)>&& func) {
-      traverse_func_ = std::move(func);
-    }
+    void push(Socket* conn) { closed_.emplace_back(conn); }
 
-    void push_handle(socket_t handle) { clean_handles_.emplace(handle); }
-    void traverse() {
-      if (traverse_func_ != nullptr) {
-        for (const socket_t handle : clean_handles_) {
-          traverse_func_(handle);
-        }
-      }
-    }
+    // hand every closed socket to release(Socket*). Sockets closed while releasing, or still referenced
+    // by in-flight I/O, wait for the next round; force skips the in-flight check once nothing can
+    // complete anymore
+    template <typename Release>
+    void traverse(Release&& release, bool force = false);
 
     void clear() {
-      if (!clean_handles_.empty()) { clean_handles_.clear(); }
+      if (!closed_.empty()) { closed_.clear(); }
     }
   private:
-    std::set<socket_t>            clean_handles_;
-    std::function<void(socket_t)> traverse_func_;
+    std::vector<Socket*>  closed_;
+    std::vector<Socket*>  releasing_;
+  };
+
+  // per-connection socket options, fields left at -1 keep the kernel default. Options a platform or
+  // socket family lacks (busy poll, quickack, TCP options on unix sockets) are skipped or rejected
+  struct SocketOptions {
+    int nodelay         = -1; // TCP_NODELAY, 1 sends small writes at once instead of waiting for Nagle
+    int quickack        = -1; // TCP_QUICKACK (Linux), the kernel may fall back to delayed acks later
+    int recv_buff_size  = -1; // SO_RCVBUF in bytes
+    int send_buff_size  = -1; // SO_SNDBUF in bytes
+    int busy_poll_us    = -1; // SO_BUSY_POLL (Linux), spin on the device queue for up to this long
+    int notsent_lowat   = -1; // TCP_NOTSENT_LOWAT (Linux), unsent bytes kept in the kernel send queue
+
+    // request/response traffic: no Nagle, immediate acks and a shallow kernel send queue
+    static SocketOptions low_latency() {
+      SocketOptions options;
+      options.nodelay       = 1;
+      options.quickack      = 1;
+      options.notsent_lowat = 16 * 1024;
+      return options;
+    }
+
+    // bulk transfers: Nagle on and large kernel buffers
+    static SocketOptions throughput(int buff_size = 4 * 1024 * 1024) {
+      SocketOptions options;
+      options.nodelay         = 0;
+      options.recv_buff_size  = buff_size;
+      options.send_buff_size  = buff_size;
+      return options;
+    }
+  };
+
+  // callbacks of one socket that take precedence over the poller's, see Socket::set_callbacks()
+  struct SocketCallbacks {
+    DataCallback  on_data   = nullptr;
+    ReadCallback  on_read   = nullptr;
+    CloseCallback on_close  = nullptr;
+  };
+
+  // a timer owned by a socket, it finds its socket through conn
+  struct SocketTimer : TimerNode {
+    Socket* conn = nullptr;
   };
 
 #ifdef _WIN32
@@ -49,17 +96,24 @@ namespace coxnet {
 public:
     friend class Poller;
     friend class IPoller;
-    explicit Socket(socket_t native_handle, Cleaner* cleaner = nullptr, int epoll_fd = -1) {
+    friend class Cleaner;
+    explicit Socket(socket_t native_handle, Cleaner* cleaner = nullptr, int epoll_fd = -1, IPoller* poller = nullptr) {
       handle_   = native_handle;
       cleaner_  = cleaner;
+      poller_   = poller;
 
 #ifdef __linux__
       epoll_fd_ = epoll_fd;
 #endif
 
+      idle_timer_.conn        = this;
+      idle_timer_.on_expire_  = &Socket::_on_idle_timer;
+      read_timer_.conn        = this;
+      read_timer_.on_expire_  = &Socket::_on_read_timer;
+
       if (!Socket::_is_listener()) {
-        read_buff_  = new SimpleBuffer(max_read_buff_size);
-        write_buff_ = new SimpleBuffer(max_write_buff_size);
+        read_buff_  = new SimpleBuffer(max_read_buff_size, _buffer_pool());
+        write_buff_ = new WriteChain(max_write_buff_size, _buffer_pool());
       }
     }
 
@@ -77,84 +131,377 @@ public:
     Socket& operator=(Socket&& other) = delete;
 
     socket_t native_handle() const { return handle_; }
-    bool is_valid() const { return handle_ != invalid_socket && err_ == 0 && !user_closed_; }
+    // safe to keep after the socket is gone, see IPoller::find() and IPoller::write()
+    ConnId id() const { return conn_id_; }
+    bool is_valid() const { return handle_ != invalid_socket && !closed_; }
 
     void user_close() {
       user_closed_ = true;
       _close_handle(0);
     }
 
+    // bytes queued in user space that the kernel has not taken yet
+    size_t pending_write_bytes() const { return write_buff_ != nullptr ? write_buff_->size() : 0; }
+
+    // the poller's high watermark callback fires once pending_write_bytes() reaches high, the low one
+    // once it drains back to low. high 0 disables both. Poller thread only
+    void set_write_watermarks(size_t high, size_t low) {
+      high_watermark_ = high;
+      low_watermark_  = low < high ? low : high;
+      above_high_     = false;
+    }
+
+    // stop taking data from the kernel, the peer is throttled by TCP flow control once the kernel's
+    // receive buffer is full. Poller thread only
+    void pause_reading() {
+      if (reading_paused_ || !is_valid()) { return; }
+      reading_paused_ = true;
+      _update_reading();
+    }
+
+    void resume_reading() {
+      if (!reading_paused_ || !is_valid()) { return; }
+      reading_paused_ = false;
+      _update_reading();
+    }
+
+    bool is_reading_paused() const { return reading_paused_; }
+
+    // user state carried by the socket, e.g. its session, so callbacks need no lookup. Not owned
+    void set_context(void* context) { context_ = context; }
+    void* context() const { return context_; }
+    template <typename T>
+    T* context() const { return static_cast<T*>(context_); }
+
+    // callbacks for this socket only, those left nullptr fall back to the poller's. A data callback
+    // set here also overrides the poller's read callback and the other way round. Poller thread only
+    void set_callbacks(DataCallback on_data, CloseCallback on_close = nullptr) {
+      _callbacks().on_data  = std::move(on_data);
+      _callbacks().on_close = std::move(on_close);
+    }
+
+    // consuming variant for this socket only, see IPoller::set_read_callback(). Poller thread only
+    void set_read_callback(ReadCallback on_read) { _callbacks().on_read = std::move(on_read); }
+
+    // apply the fields of options that are set, false when the socket rejected any of them. Sockets
+    // get the poller's options when they are accepted or dialed, see IPoller::set_socket_options()
+    bool set_options(const SocketOptions& options) {
+      if (!is_valid()) { return false; }
+
+      bool ok = true;
+      ok &= _set_option(IPPROTO_TCP, TCP_NODELAY, options.nodelay);
+      ok &= _set_option(SOL_SOCKET, SO_RCVBUF, options.recv_buff_size);
+      ok &= _set_option(SOL_SOCKET, SO_SNDBUF, options.send_buff_size);
+#ifdef __linux__
+      ok &= _set_option(IPPROTO_TCP, TCP_QUICKACK, options.quickack);
+      ok &= _set_option(SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_us);
+      ok &= _set_option(IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.notsent_lowat);
+#endif // __linux__
+      return ok;
+    }
+
+    // close because of a protocol error, on_close gets err_code instead of 0. Poller thread only
+    void close_with_error(int err_code) { _close_handle(err_code); }
+
     std::pair<const char*, uint16_t> remote_addr() { return {remote_addr_str_, remote_port_}; }
 
+    // close with ETIMEDOUT after timeout_ms without reads or writes, 0 disables. Poller thread only
+    void set_idle_timeout(uint32_t timeout_ms);
+    // close with ETIMEDOUT unless data arrives within timeout_ms, each call re-arms it and 0 cancels.
+    // Poller thread only
+    void set_read_deadline(uint32_t timeout_ms);
+
+    // All writes are safe to call from any thread: off the poller thread they go through the poller's
+    // lock-free send queue and are flushed by the poller thread on its next wakeup.
+    // Returns the number of bytes accepted, what the kernel does not take at once is queued. A closed
+    // socket refuses writes: -1 on the poller thread, 0 from any other.
     int write(const char* data, size_t size) {
+      std::string_view part(data, size);
+      return writev(&part, 1);
+    }
+
+    // owned buffers are queued without copying and released once sent
+    int write(std::string&& data)       { return _write_owned(std::move(data)); }
+    int write(std::vector<char>&& data) { return _write_owned(std::move(data)); }
+    int write(BufferSlice slice)        { return _write_owned(std::move(slice)); }
+
+#ifdef __linux__
+    // queue size bytes of the file fd from offset behind the pending output, they go from the page
+    // cache to the socket with sendfile. fd must stay open until on_done, which gets 0 once the
+    // range was sent or the error that closed the socket first. Poller thread only
+    int send_file(int fd, uint64_t offset, size_t size, SendFileCallback on_done = nullptr) {
+      if (!is_valid() || user_closed_ || err_ != 0 || fd < 0) {
+        return -1;
+      }
+
+      if (size == 0) {
+        if (on_done != nullptr) { on_done(this, 0); }
+        return 0;
+      }
+
+      std::function<void(int)> done = nullptr;
+      if (on_done != nullptr) {
+        done = [this, on_done = std::move(on_done)](int err) { on_done(this, err); };
+      }
+
+      _touch();
+      write_buff_->write_file(fd, offset, size, std::move(done));
+      _check_high_watermark();
+      _flush();
+      return 0;
+    }
+#endif // __linux__
+
+    // sendmsg batches of at least threshold bytes go out with MSG_ZEROCOPY: the kernel reads the queued
+    // pages in place and they are released once it reports the send completed, see
+    // IPoller::set_zerocopy_callback(). Owned buffers of that size skip the direct send so they can be
+    // kept alive. False when the kernel or the poller does not support it. Poller thread only
+    bool enable_zerocopy(size_t threshold = zerocopy_threshold) {
+#if defined(__linux__) && !defined(COXNET_USE_IO_URING) && defined(SO_ZEROCOPY)
+      int enable = 1;
+      if (!is_valid() || threshold == 0 ||
+          ::setsockopt(handle_, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) != 0) {
+        return false;
+      }
+
+      zerocopy_threshold_ = threshold;
+      return true;
+#else
+      (void)threshold;
+      return false;
+#endif
+    }
+
+    // gather write, e.g. a frame header and its payload go out in one syscall
+    int writev(std::initializer_list<std::string_view> parts) { return writev(parts.begin(), parts.size()); }
+    int writev(const std::string_view* parts, size_t count) {
+      if (!_in_loop_thread()) {
+        return _post_write(parts, count);
+      }
+
       if (!is_valid() || user_closed_ || err_ != 0) {
         return -1;
       }
-      
-      if (write_buff_->written_size_from_seek() > 0) {
-        write_buff_->write(data, size);
-        return static_cast<int>(size);
+
+      size_t total_size = 0;
+      for (size_t i = 0; i < count; i++) {
+        total_size += parts[i].size();
       }
+      _touch();
 
-      size_t  total_sent   = 0;
-      size_t  data_size    = size;
-      
-      while (total_sent < data_size) {
-        int sent_n = ::send(native_handle(), data + total_sent, data_size - total_sent, 0);
-        if (sent_n > 0) {
-          total_sent += sent_n;
+      size_t sent = 0;
+      if (write_buff_->empty() && !_send_direct(parts, count, sent)) {
+        return -1;
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        if (sent >= parts[i].size()) {
+          sent -= parts[i].size();
           continue;
-        }  
-        
+        }
+
+        write_buff_->write(parts[i].data() + sent, parts[i].size() - sent);
+        sent = 0;
+      }
+
+      if (!write_buff_->empty()) {
+        if (!flush_queued_) { _wait_writable(true); }
+        _check_high_watermark();
+      }
+      return static_cast<int>(total_size);
+    }
+
+private:
+    template <typename Owned>
+    int _write_owned(Owned&& buffer) {
+      if (!_in_loop_thread()) {
+        return _post_write(_to_slice(std::move(buffer)));
+      }
+
+      if (!is_valid() || user_closed_ || err_ != 0) {
+        return -1;
+      }
+
+      std::string_view  part  = _view_of(buffer);
+      const size_t      size  = part.size();
+      size_t            sent  = 0;
+      _touch();
+      if (_zerocopy_size(size)) {
+        write_buff_->write(_to_slice(std::move(buffer)));
+        _check_high_watermark();
+        _flush();
+        return static_cast<int>(size);
+      }
+
+      if (write_buff_->empty() && !_send_direct(&part, 1, sent)) {
+        return -1;
+      }
+
+      // only what the kernel did not take gets wrapped and linked into the chain
+      if (sent < size) {
+        BufferSlice slice = _to_slice(std::move(buffer));
+        slice.data += sent;
+        slice.size -= sent;
+        write_buff_->write(std::move(slice));
+        if (!flush_queued_) { _wait_writable(true); }
+        _check_high_watermark();
+      }
+
+      return static_cast<int>(size);
+    }
+
+    static std::string_view _view_of(const BufferSlice& slice) { return {slice.data, slice.size}; }
+    template <typename Owned>
+    static std::string_view _view_of(const Owned& buffer) { return {buffer.data(), buffer.size()}; }
+
+    template <typename Owned>
+    static BufferSlice _to_slice(Owned&& buffer) {
+      if constexpr (std::is_same_v<std::decay_t<Owned>, BufferSlice>) {
+        return std::move(buffer);
+      } else {
+        return BufferSlice::from(std::move(buffer));
+      }
+    }
+
+    // one attempt to send parts straight away while nothing is queued, sent is what the kernel took
+    bool _send_direct([[maybe_unused]] const std::string_view* parts, [[maybe_unused]] size_t count, size_t& sent) {
+      sent = 0;
+      if (connecting_ || _cork()) { return true; }
+
+#ifdef COXNET_USE_IO_URING
+      // io_uring submits the sends of one loop iteration together, always go through the chain
+      return true;
+#else
+      IoVec  vecs[max_iov_per_write];
+      size_t vec_count = std::min(count, max_iov_per_write);
+      for (size_t i = 0; i < vec_count; i++) {
+        vecs[i] = _make_vec(parts[i].data(), parts[i].size());
+      }
+
+      while (true) {
+        int sent_n = _send_vecs(vecs, vec_count);
+        if (sent_n >= 0) {
+          sent = static_cast<size_t>(sent_n);
+          _on_sent(sent);
+          return true;
+        }
+
         int err_code = get_last_error();
         if (handle_error_action(err_code) == ErrorAction::kRetry) {
-          write_buff_->write(data + total_sent, data_size - total_sent);
-#ifdef __linux__
-          epoll_event ev  = {};
-          ev.events       = EPOLLIN | EPOLLOUT | EPOLLET; 
-          ev.data.ptr     = this ;
-          epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handle_, &ev);
-#endif // __linux__
-          break;
+          _on_send_again();
+          return true;
         }
+        if (handle_error_action(err_code) == ErrorAction::kContinue) { continue; }
 
-        if (handle_error_action(err_code) == ErrorAction::kContinue) {
-          continue;
+        _close_handle(err_code);
+        return false;
+      }
+#endif
+    }
+
+    static IoVec _make_vec(const char* data, size_t size) {
+      IoVec vec = {};
+#ifdef _WIN32
+      vec.buf       = const_cast<char*>(data);
+      vec.len       = static_cast<ULONG>(size);
+#else
+      vec.iov_base  = const_cast<char*>(data);
+      vec.iov_len   = size;
+#endif
+      return vec;
+    }
+
+    int _send_vecs(IoVec* vecs, size_t count, int flags = 0) {
+#ifdef _WIN32
+      DWORD sent_n = 0;
+      if (::WSASend(handle_, vecs, static_cast<DWORD>(count), &sent_n, 0, nullptr, nullptr) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+      }
+      return static_cast<int>(sent_n);
+#else
+      msghdr msg      = {};
+      msg.msg_iov     = vecs;
+      msg.msg_iovlen  = count;
+      return static_cast<int>(::sendmsg(handle_, &msg, send_flags | flags));
+#endif
+    }
+
+    bool _zerocopy_size(size_t size) const {
+#ifdef __linux__
+      return zerocopy_threshold_ != 0 && size >= zerocopy_threshold_;
+#else
+      (void)size;
+      return false;
+#endif
+    }
+
+    // one sendmsg for the memory segments up to the next file range, or one sendfile for that range
+    int _send_front(bool& zerocopy) {
+      zerocopy = false;
+#ifdef __linux__
+      int       fd      = -1;
+      uint64_t  offset  = 0;
+      size_t    size    = 0;
+      if (write_buff_->front_file(fd, offset, size)) {
+        off_t   pos     = static_cast<off_t>(offset);
+        ssize_t sent_n  = ::sendfile(handle_, fd, &pos, std::min(size, max_size_per_sendfile));
+        // the file ended before the range did, the stream can not be completed
+        if (sent_n == 0) {
+          errno = EIO;
+          return SOCKET_ERROR;
         }
+        return static_cast<int>(sent_n);
+      }
+#endif // __linux__
 
-        _close_handle(err_code);
-        return -1;
+      IoVec   vecs[max_iov_per_write];
+      size_t  vec_count = write_buff_->fill(vecs, max_iov_per_write);
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+      size_t  batch     = 0;
+      for (size_t i = 0; i < vec_count; i++) {
+        batch += vecs[i].iov_len;
       }
 
-      return static_cast<int>(total_sent);
+      if (_zerocopy_size(batch)) {
+        int sent_n = _send_vecs(vecs, vec_count, MSG_ZEROCOPY);
+        // over the socket's optmem limit for pinned pages, this batch is copied instead
+        if (sent_n >= 0 || get_last_error() != ENOBUFS) {
+          zerocopy = sent_n > 0;
+          return sent_n;
+        }
+      }
+#endif
+      return _send_vecs(vecs, vec_count);
     }
 
-private:
+    // flush the chain, one sendmsg per batch of segments until it is empty or the socket is full
     size_t _write_by_io_event() {
-      if (write_buff_->written_size_from_seek() <= 0) {
+      if (write_buff_->empty()) {
         return 0;
       }
 
-      size_t total_sent   = 0;
-      size_t data_size    = write_buff_->written_size_from_seek();
-      while (total_sent < data_size) {
-        int sent_n = ::send(native_handle(), write_buff_->take_data_from_seek(), 
-                            write_buff_->written_size_from_seek(), 0);
+      size_t total_sent = 0;
+      while (!write_buff_->empty()) {
+        bool  zerocopy  = false;
+        int   sent_n    = _send_front(zerocopy);
         if (sent_n > 0) {
           total_sent += sent_n;
-          write_buff_->seek(sent_n);
+          _on_sent(static_cast<size_t>(sent_n));
+          if (zerocopy) {
+            write_buff_->consume_zerocopy(static_cast<size_t>(sent_n), zerocopy_seq_++);
+          } else {
+            write_buff_->consume(static_cast<size_t>(sent_n));
+          }
+          _check_low_watermark();
+          if (!is_valid()) { return total_sent; }
           continue;
         } 
           
         const int err_code = get_last_error();
         if (handle_error_action(err_code) == ErrorAction::kRetry) {
-#ifdef __linux__
-          epoll_event ev  = {};
-          ev.events       = EPOLLIN | EPOLLOUT | EPOLLET; 
-          ev.data.ptr     = this ;
-          epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handle_, &ev);
-#endif // __linux__
-          break;
+          _on_send_again();
+          _wait_writable(true);
+          return total_sent;
         }
 
         if (handle_error_action(err_code) == ErrorAction::kContinue) {
@@ -165,55 +512,163 @@ private:
         return -1;
       }
 
-      if (total_sent >= data_size) {
-        write_buff_->clear();
+      _wait_writable(false); // remove EPOLLOUT
+      return total_sent;
+    }
+
+#ifdef COXNET_USE_IO_URING
+    // queue the socket for the next batched send submission, defined by the io_uring poller
+    void _wait_writable(bool enable);
+    // cancel or re-arm the multishot recv, defined by the io_uring poller
+    void _update_reading();
+#else
+    // EPOLLOUT is only registered while there is buffered data, skip epoll_ctl when nothing changes
+    void _wait_writable(bool enable) {
+      if (wait_writable_ == enable) {
+        return;
+      }
+
+      wait_writable_ = enable;
+      _update_events();
+    }
+
+    // EPOLLIN is dropped while reading is paused, a MOD re-checks readiness so nothing is missed on resume
+    void _update_reading() { _update_events(); }
+
+    void _update_events() {
 #ifdef __linux__
-        epoll_event ev  = {};
-        ev.events       = EPOLLIN | EPOLLET; // remove EPOLLOUT
-        ev.data.ptr     = this ;
-        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handle_, &ev);
+      epoll_event ev  = {};
+      ev.events       = EPOLLET | EPOLLRDHUP | (reading_paused_ ? 0u : static_cast<uint32_t>(EPOLLIN)) |
+                        (wait_writable_ ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+      ev.data.ptr     = this ;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handle_, &ev);
 #endif // __linux__
+    }
+#endif
+
+    // writes issued during the handshake were only buffered, send them now
+    void _resume_after_connect() {
+#ifdef COXNET_USE_IO_URING
+      wait_writable_ = false;
+      if (!write_buff_->empty()) { _wait_writable(true); }
+#else
+      if (write_buff_->empty()) {
+        _wait_writable(false);
+      } else {
+        _write_by_io_event();
       }
+#endif
+    }
 
-      return total_sent;
+    // send whatever is buffered, with EPOLLOUT registered it goes out on the next writable event
+    void _flush() {
+#ifdef COXNET_USE_IO_URING
+      _wait_writable(true);
+#else
+      if (!wait_writable_) { _write_by_io_event(); }
+#endif
+    }
+
+    bool _in_loop_thread() const;
+    // queue the socket for the flush at the end of the poll iteration when auto-cork is on
+    bool _cork();
+    // metrics hooks, defined by the poller
+    void _on_sent(size_t bytes);
+    void _on_send_again();
+    void _on_queued();
+
+    // each crossing is reported once, the low callback only after the high one has fired. Called
+    // whenever output was queued, which is also when the queue depth is sampled
+    void _check_high_watermark() {
+      _on_queued();
+      if (high_watermark_ != 0 && !above_high_ && write_buff_->size() >= high_watermark_) {
+        above_high_ = true;
+        _fire_watermark(true);
+      }
+    }
+
+    void _check_low_watermark() {
+      if (above_high_ && write_buff_->size() <= low_watermark_) {
+        above_high_ = false;
+        _fire_watermark(false);
+      }
+    }
+    void _fire_watermark(bool high);
+
+
+    // only sockets with their own callbacks pay for them
+    SocketCallbacks& _callbacks() {
+      if (callbacks_ == nullptr) { callbacks_ = std::make_unique<SocketCallbacks>(); }
+      return *callbacks_;
     }
 
+    // value -1 leaves the option alone
+    bool _set_option(int level, int name, int value) {
+      if (value < 0) { return true; }
+      return ::setsockopt(handle_, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+    }
+
+    // the idle timer only looks at last_active_ms_ when it fires, activity itself never touches the wheel
+    void _touch() {
+      if (idle_timeout_ms_ != 0) { _mark_active(); }
+    }
+    void _mark_active();
+    void _on_read_activity();
+    static void _on_idle_timer(TimerNode* node);
+    static void _on_read_timer(TimerNode* node);
+    SlabPool* _buffer_pool() const;
+    int _post_write(const std::string_view* parts, size_t count);
+    int _post_write(BufferSlice&& slice);
+
+    // the handle itself stays open until the cleaner releases the socket, so the kernel can not hand
+    // the same fd to a new connection while this one is still in the connection table
     void _close_handle(int err = 0) {
-      if (!is_valid()) {
+      if (closed_ || handle_ == invalid_socket) {
         return;
       }
 
-#ifdef _WIN32
-      closesocket(handle_);
-#endif
+      closed_ = true;
+      err_    = err;
 
-#ifdef __linux__
+      if (cleaner_ == nullptr) {
+        _release_handle();
+        return;
+      }
+
+#if defined(__linux__) && defined(COXNET_USE_IO_URING)
+      // wakes the multishot recv still owned by the ring, the object outlives it
+      ::shutdown(handle_, SHUT_RDWR);
+#elif defined(__linux__)
       epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, handle_, nullptr);
-      close(handle_);
 #endif
 
-      handle_ = invalid_socket;
-      err_    = err;
-
-      if (cleaner_ != nullptr) {
-        cleaner_->push_handle(handle_);
-      }
+      cleaner_->push(this);
     }
 
-    virtual bool _is_listener() { return false; }
+    void _release_handle() {
+      if (handle_ == invalid_socket) {
+        return;
+      }
 
-    static bool _set_non_blocking(socket_t handle) {
 #ifdef _WIN32
-      u_long  option = 1;
-      return ioctlsocket(handle, FIONBIO, &option) == 0;
+      closesocket(handle_);
+#else
+      close(handle_);
 #endif
+      handle_ = invalid_socket;
+    }
 
-#if defined (__linux__) || (__APPLE__)
-      int option = fcntl(handle, F_GETFL, 0);
-      return fcntl(handle, F_SETFL, option | O_NONBLOCK) == 0;
+    // in-flight io_uring operations still point at this socket
+    bool _io_pending() const {
+#ifdef COXNET_USE_IO_URING
+      return uring_ops_ > 0;
+#else
+      return false;
 #endif
     }
 
+    virtual bool _is_listener() { return false; }
+
     void _set_remote_addr(const char* addr_str, uint16_t port) {
       if (addr_str) {
         strncpy(remote_addr_str_, addr_str, INET6_ADDRSTRLEN - 1);
@@ -225,29 +680,58 @@ private:
       remote_port_ = port;
     }
 #ifdef _WIN32
-    void _overlapped() {
-      read_buff_->ensure_writable_size(max_size_per_read);
+    bool _overlapped() {
+      if (!read_buff_->ensure_writable_size(max_size_per_read)) { return false; }
+
       memset(&recv_context_for_win_.Overlapped, 0, sizeof(recv_context_for_win_.Overlapped));
-      recv_context_for_win_.Buf.buf = this->read_buff_->take_data();
+      recv_context_for_win_.Buf.buf = this->read_buff_->writable_data();
       recv_context_for_win_.Buf.len = this->read_buff_->writable_size();
       recv_context_for_win_.Conn    = this;
+      return true;
     }
     friend void WINAPI IOCompletionCallBack(DWORD, DWORD, LPOVERLAPPED);
 #endif //_WIN32
   private:
     socket_t          handle_           = invalid_socket;
+    ConnId            conn_id_          = invalid_conn_id;
     SimpleBuffer*     read_buff_        = nullptr;
-    SimpleBuffer*     write_buff_       = nullptr;
+    WriteChain*       write_buff_       = nullptr;
     bool              io_completed_     = false;
 
     int               err_              = 0;
     bool              user_closed_      = false;
+    std::atomic<bool> closed_           = { false }; // also read by writers on other threads
     Cleaner*          cleaner_          = nullptr;
+    IPoller*          poller_           = nullptr;
+    bool              wait_writable_    = false;
+    bool              flush_queued_     = false;
+    bool              connecting_       = false;
+    bool              reading_paused_   = false;
+    bool              above_high_       = false;
+    size_t            high_watermark_   = 0;
+    size_t            low_watermark_    = 0;
+    ConnectCallback   on_connect_       = nullptr;
+    std::unique_ptr<SocketCallbacks> callbacks_;
+    void*             context_          = nullptr;
+
+    SocketTimer       idle_timer_;
+    SocketTimer       read_timer_;
+    uint32_t          idle_timeout_ms_  = 0;
+    uint64_t          last_active_ms_   = 0;
 
     char              remote_addr_str_[INET6_ADDRSTRLEN]  = { 0 };
     uint32_t          remote_port_                        = 0;
 #ifdef __linux__
     int               epoll_fd_           = -1;    
+    bool              read_ready_         = false; // queued in the epoll poller's ready list
+    size_t            zerocopy_threshold_ = 0;
+    uint32_t          zerocopy_seq_       = 0;     // the kernel numbers MSG_ZEROCOPY sends from 0
+#endif
+
+#ifdef COXNET_USE_IO_URING
+    bool              send_inflight_      = false;
+    bool              recv_armed_         = false;
+    uint32_t          uring_ops_          = 0;
 #endif
 
 #ifdef _WIN32
@@ -258,10 +742,53 @@ private:
   class listener final : public Socket {
   public:
     explicit listener(socket_t sock) : Socket(sock) {}
+
+#ifndef _WIN32
+    // a unix listener bound to a path removes its socket file when it goes away, unless the path
+    // was taken over by another socket since
+    listener(socket_t sock, const char address[]) : Socket(sock) {
+      struct stat info = {};
+      if (address[0] == '/' && ::stat(address, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unix_path_  = address;
+        unix_dev_   = info.st_dev;
+        unix_ino_   = info.st_ino;
+      }
+    }
+
+    ~listener() override {
+      struct stat info = {};
+      if (!unix_path_.empty() && ::stat(unix_path_.c_str(), &info) == 0 &&
+          info.st_dev == unix_dev_ && info.st_ino == unix_ino_) {
+        ::unlink(unix_path_.c_str());
+      }
+    }
+#endif
   private:
     bool _is_listener() override { return true; }
+
+#ifndef _WIN32
+    std::string unix_path_;
+    dev_t       unix_dev_ = 0;
+    ino_t       unix_ino_ = 0;
+#endif
   };
 
+  template <typename Release>
+  void Cleaner::traverse(Release&& release, bool force) {
+    if (closed_.empty()) { return; }
+
+    releasing_.swap(closed_);
+    for (Socket* conn : releasing_) {
+      if (!force && conn->_io_pending()) {
+        closed_.emplace_back(conn);
+        continue;
+      }
+
+      release(conn);
+    }
+    releasing_.clear();
+  }
+
   static void initialize_socket_env() {
 #ifdef _WIN32
     WSAData wsa_data = {};
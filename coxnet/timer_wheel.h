@@ -0,0 +1,229 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace coxnet {
+  // intrusive timer, embed it (or derive from it) to put an object on the wheel without allocating
+  struct TimerNode {
+    TimerNode*  prev_       = nullptr;
+    TimerNode*  next_       = nullptr;
+    uint64_t    expire_     = 0;        // absolute tick
+    uint16_t    slot_       = 0;        // list head it is linked into
+    void        (*on_expire_)(TimerNode* node) = nullptr;
+
+    bool pending() const { return next_ != nullptr; }
+  };
+
+  // Hierarchical timing wheel with 1ms ticks: 256 slots for the next 256ms, then three levels of
+  // 64 slots each covering up to ~18 hours, longer timers are parked in the last level and
+  // re-cascaded. Add and cancel are O(1), occupancy bitmaps give the next expiry so an idle wheel
+  // neither wakes the poller nor walks empty slots.
+  class TimerWheel {
+  public:
+    TimerWheel() {
+      for (TimerNode& head : heads_) {
+        head.prev_ = head.next_ = &head;
+      }
+      current_ = now_ms();
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    static uint64_t now_ms() {
+      using namespace std::chrono;
+      return static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    // the time of the last advance(), cheap to read from callbacks
+    uint64_t current() const { return current_; }
+    bool empty() const { return count_ == 0; }
+
+    // (re)schedule node to expire at the absolute tick expire, a tick in the past fires on the next advance
+    void add(TimerNode* node, uint64_t expire) {
+      cancel(node);
+      node->expire_ = expire;
+      _link(node, current_ + 1);
+      count_++;
+    }
+
+    void cancel(TimerNode* node) {
+      if (!node->pending()) { return; }
+
+      node->prev_->next_  = node->next_;
+      node->next_->prev_  = node->prev_;
+      node->prev_         = node->next_ = nullptr;
+      count_--;
+
+      TimerNode& head = heads_[node->slot_];
+      if (head.next_ == &head) { _clear_bit(node->slot_); }
+    }
+
+    // ms until the next timer is due (or the next cascade that may make one due), -1 when there is none
+    int next_timeout(uint64_t now) const {
+      if (count_ == 0) { return -1; }
+
+      const uint64_t delta    = _ticks_to_next_event();
+      const uint64_t due      = current_ + delta;
+      if (due <= now) { return 0; }
+
+      const uint64_t timeout  = due - now;
+      return timeout > INT32_MAX ? INT32_MAX : static_cast<int>(timeout);
+    }
+
+    // run every timer that is due by now
+    void advance(uint64_t now) {
+      while (current_ < now) {
+        const uint64_t delta = count_ == 0 ? UINT64_MAX : _ticks_to_next_event();
+        if (delta > now - current_) {
+          current_ = now;
+          break;
+        }
+
+        current_ += delta;
+        _cascade();
+        _expire(current_ & level0_mask);
+      }
+    }
+  private:
+    static constexpr int      level0_bits   = 8;
+    static constexpr int      level_bits    = 6;
+    static constexpr int      levels        = 4;
+    static constexpr uint64_t level0_size   = 1ull << level0_bits;
+    static constexpr uint64_t level_size    = 1ull << level_bits;
+    static constexpr uint64_t level0_mask   = level0_size - 1;
+    static constexpr uint64_t level_mask    = level_size - 1;
+    static constexpr uint64_t max_span      = 1ull << (level0_bits + level_bits * (levels - 1));
+    static constexpr size_t   slot_count    = level0_size + level_size * (levels - 1);
+
+    static int _shift(int level) { return level == 0 ? 0 : level0_bits + level_bits * (level - 1); }
+    static size_t _first_slot(int level) { return level == 0 ? 0 : level0_size + level_size * (level - 1); }
+
+    // earliest is the first tick whose slot has not been expired yet
+    void _link(TimerNode* node, uint64_t earliest) {
+      uint64_t expire = node->expire_ > earliest ? node->expire_ : earliest;
+      uint64_t delta  = expire - current_;
+      if (delta >= max_span) {
+        expire  = current_ + max_span - 1;
+        delta   = max_span - 1;
+      }
+
+      size_t slot = 0;
+      if (delta < level0_size) {
+        slot = expire & level0_mask;
+      } else {
+        int level = 1;
+        while (delta >= (1ull << _shift(level + 1))) { level++; }
+        slot = _first_slot(level) + ((expire >> _shift(level)) & level_mask);
+      }
+
+      TimerNode& head   = heads_[slot];
+      node->slot_       = static_cast<uint16_t>(slot);
+      node->prev_       = head.prev_;
+      node->next_       = &head;
+      head.prev_->next_ = node;
+      head.prev_        = node;
+      _set_bit(slot);
+    }
+
+    // the tick has just been reached, move the upper level slots that roll over into lower ones
+    void _cascade() {
+      for (int level = 1; level < levels; level++) {
+        if ((current_ & ((1ull << _shift(level)) - 1)) != 0) { return; }
+
+        const size_t slot = _first_slot(level) + ((current_ >> _shift(level)) & level_mask);
+        TimerNode    pending;
+        if (!_take(slot, pending)) { continue; }
+
+        while (pending.next_ != &pending) {
+          TimerNode* node     = pending.next_;
+          pending.next_       = node->next_;
+          node->next_->prev_  = &pending;
+          _link(node, current_);
+        }
+      }
+    }
+
+    void _expire(size_t slot) {
+      TimerNode due;
+      if (!_take(slot, due)) { return; }
+
+      // callbacks may add or cancel any timer, including the ones still in due
+      while (due.next_ != &due) {
+        TimerNode* node     = due.next_;
+        due.next_           = node->next_;
+        node->next_->prev_  = &due;
+        node->prev_         = node->next_ = nullptr;
+        count_--;
+        if (node->on_expire_ != nullptr) { node->on_expire_(node); }
+      }
+    }
+
+    // splice the list of slot into out, false when it is empty
+    bool _take(size_t slot, TimerNode& out) {
+      TimerNode& head = heads_[slot];
+      if (head.next_ == &head) { return false; }
+
+      out.next_           = head.next_;
+      out.prev_           = head.prev_;
+      out.next_->prev_    = &out;
+      out.prev_->next_    = &out;
+      head.prev_          = head.next_ = &head;
+      _clear_bit(slot);
+      return true;
+    }
+
+    uint64_t _ticks_to_next_event() const {
+      uint64_t best = UINT64_MAX;
+      for (int level = 0; level < levels; level++) {
+        const uint64_t size   = level == 0 ? level0_size : level_size;
+        const uint64_t index  = (current_ >> _shift(level)) & (size - 1);
+        const uint64_t k      = _find_from(_first_slot(level), size, index);
+        if (k == 0) { continue; }
+
+        // the slot k positions ahead is reached, or cascaded, at this tick
+        const uint64_t tick = (((current_ >> _shift(level)) + k) << _shift(level));
+        if (tick - current_ < best) { best = tick - current_; }
+      }
+      return best;
+    }
+
+    // distance 1..size from index to the next occupied slot of a level, 0 when it is empty
+    uint64_t _find_from(size_t first, uint64_t size, uint64_t index) const {
+      uint64_t pos = _scan(first, index + 1, size);
+      if (pos != UINT64_MAX) { return pos - index; }
+
+      pos = _scan(first, 0, index + 1);
+      if (pos != UINT64_MAX) { return pos + size - index; }
+      return 0;
+    }
+
+    // first occupied position in [from, to) of the level starting at slot first, levels are word aligned
+    uint64_t _scan(size_t first, uint64_t from, uint64_t to) const {
+      while (from < to) {
+        const size_t    slot  = first + from;
+        const uint64_t  word  = bitmap_[slot >> 6] >> (slot & 63);
+        if (word != 0) {
+          const uint64_t pos = from + static_cast<uint64_t>(std::countr_zero(word));
+          return pos < to ? pos : UINT64_MAX;
+        }
+
+        from += 64 - (slot & 63);
+      }
+      return UINT64_MAX;
+    }
+
+    void _set_bit(size_t slot)    { bitmap_[slot >> 6] |= (1ull << (slot & 63)); }
+    void _clear_bit(size_t slot)  { bitmap_[slot >> 6] &= ~(1ull << (slot & 63)); }
+  private:
+    TimerNode heads_[slot_count];
+    uint64_t  bitmap_[slot_count / 64]  = {};
+    uint64_t  current_                  = 0;
+    size_t    count_                    = 0;
+  };
+} // namespace coxnet
+
+#endif // TIMER_WHEEL_H
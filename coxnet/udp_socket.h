@@ -0,0 +1,367 @@
+#ifndef UDP_SOCKET_H
+#define UDP_SOCKET_H
+
+#ifdef __linux__
+
+#include "io_def.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <netinet/udp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace coxnet {
+  class IPoller;
+  class UdpSockets;
+
+  // one received datagram, data and addr point into the socket's receive batch and are only valid
+  // during the callback
+  struct Datagram {
+    const char*     data      = nullptr;
+    size_t          size      = 0;
+    const sockaddr* addr      = nullptr;
+    socklen_t       addr_len  = 0;
+  };
+
+  // A bound UDP socket driven by a poller. Reads drain the socket with recvmmsg and hand each batch
+  // to one callback, sends are queued and leave together with one sendmmsg when the batch is full
+  // or at the end of the poll iteration. Poller thread only.
+  class UdpSocket {
+  public:
+    friend class Poller;
+    friend class UdpSockets;
+
+    UdpSocket(socket_t handle, IPoller* poller, DatagramCallback on_datagrams, int epoll_fd = -1)
+    : handle_(handle), epoll_fd_(epoll_fd), poller_(poller), on_datagrams_(std::move(on_datagrams)) {}
+
+    ~UdpSocket() { _release_handle(); }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    socket_t native_handle() const { return handle_; }
+    bool is_valid() const { return handle_ != invalid_socket && !closed_; }
+    // datagrams truncated on receive, or refused or left over by a full socket buffer on send
+    uint64_t dropped() const { return dropped_; }
+
+    // queued datagrams are sent first, the socket is released on the poller's next cleanup
+    void close() {
+      if (closed_) { return; }
+
+      flush();
+      closed_ = true;
+      _unregister();
+      _closed();
+    }
+
+    // receive buffers hold datagrams of up to size bytes, longer ones are truncated and dropped
+    void set_datagram_size(size_t size) {
+      datagram_size_ = std::min(std::max<size_t>(size, 1), max_udp_payload);
+      recv_data_.clear();
+    }
+
+    // let the kernel coalesce the datagrams of one flow (UDP_GRO), the callback still gets them one by one
+    bool enable_gro() {
+      int enable = 1;
+      if (!is_valid() || ::setsockopt(handle_, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) != 0) { return false; }
+
+      gro_            = true;
+      datagram_size_  = max_udp_payload;
+      recv_data_.clear();
+      return true;
+    }
+
+    // queue a copy of data for addr. With segment_size the kernel cuts data into datagrams of that
+    // size (UDP_SEGMENT) and data may be up to max_udp_payload. False when closed or too large
+    bool send_to(const sockaddr* addr, socklen_t addr_len, const char* data, size_t size, uint16_t segment_size = 0) {
+      if (!is_valid() || size > max_udp_payload || addr_len > sizeof(sockaddr_storage)) { return false; }
+
+      Outgoing out;
+      out.offset        = send_data_.size();
+      out.size          = size;
+      out.addr_len      = addr_len;
+      out.segment_size  = segment_size < size ? segment_size : 0;
+      memcpy(&out.addr, addr, addr_len);
+      send_data_.insert(send_data_.end(), data, data + size);
+      outgoing_.emplace_back(out);
+
+      if (outgoing_.size() >= udp_batch_size) {
+        flush();
+      } else if (!flush_queued_) {
+        flush_queued_ = true;
+        _queue_flush();
+      }
+      return true;
+    }
+
+    // send everything queued now, returns the number of queued entries the kernel took
+    size_t flush() {
+      size_t sent  = 0;
+      size_t index = 0;
+      while (index < outgoing_.size() && handle_ != invalid_socket) {
+        const size_t count  = std::min(outgoing_.size() - index, udp_batch_size);
+        _prepare_send(index, count);
+
+        const int sent_n = ::sendmmsg(handle_, send_msgs_.data(), static_cast<unsigned>(count), 0);
+        if (sent_n > 0) {
+          sent  += static_cast<size_t>(sent_n);
+          index += static_cast<size_t>(sent_n);
+          continue;
+        }
+
+        const int err_code = get_last_error();
+        if (err_code == EINTR) { continue; }
+        // the socket buffer is full, the rest is lost like the kernel would lose it
+        if (err_code == EAGAIN || err_code == EWOULDBLOCK || err_code == ENOBUFS) { break; }
+
+        // only the first datagram was refused (EMSGSIZE, unreachable, ...), skip it
+        dropped_++;
+        index++;
+      }
+
+      dropped_ += outgoing_.size() - index;
+      outgoing_.clear();
+      send_data_.clear();
+      return sent;
+    }
+  private:
+    struct Outgoing {
+      size_t            offset        = 0;
+      size_t            size          = 0;
+      sockaddr_storage  addr          = {};
+      socklen_t         addr_len      = 0;
+      uint16_t          segment_size  = 0;
+    };
+
+    static constexpr size_t control_size = CMSG_SPACE(sizeof(uint16_t)) > CMSG_SPACE(sizeof(int))
+                                         ? CMSG_SPACE(sizeof(uint16_t)) : CMSG_SPACE(sizeof(int));
+
+    // coalesced batches are large, fewer of them are read per call
+    size_t _recv_batch() const { return gro_ ? udp_batch_size / 8 : udp_batch_size; }
+
+    // drain the socket, one callback per recvmmsg batch
+    void _read_batches() {
+      const size_t batch = _recv_batch();
+      while (is_valid()) {
+        _prepare_recv(batch);
+        const int recv_n = ::recvmmsg(handle_, recv_msgs_.data(), static_cast<unsigned>(batch), MSG_DONTWAIT, nullptr);
+        if (recv_n < 0) {
+          const int err_code = get_last_error();
+          // a queued ICMP error is reported once, the datagrams behind it are still there
+          if (err_code == EINTR || err_code == ECONNREFUSED) { continue; }
+          return;
+        }
+
+        datagrams_.clear();
+        for (int i = 0; i < recv_n; i++) {
+          _split(recv_msgs_[i]);
+        }
+
+        if (!datagrams_.empty() && on_datagrams_ != nullptr) { on_datagrams_(this, datagrams_.data(), datagrams_.size()); }
+        if (static_cast<size_t>(recv_n) < batch) { return; }
+      }
+    }
+
+    // a GRO batch carries many datagrams of gso_size bytes (the last may be shorter)
+    void _split(const mmsghdr& entry) {
+      const msghdr& msg = entry.msg_hdr;
+      if (msg.msg_flags & MSG_TRUNC) {
+        dropped_++;
+        return;
+      }
+
+      size_t segment = entry.msg_len;
+      for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+          int gso_size = 0;
+          memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+          if (gso_size > 0) { segment = static_cast<size_t>(gso_size); }
+        }
+      }
+
+      const char* data = static_cast<const char*>(msg.msg_iov->iov_base);
+      for (size_t offset = 0; offset < entry.msg_len; offset += segment) {
+        Datagram datagram;
+        datagram.data     = data + offset;
+        datagram.size     = std::min(segment, entry.msg_len - offset);
+        datagram.addr     = static_cast<const sockaddr*>(msg.msg_name);
+        datagram.addr_len = msg.msg_namelen;
+        datagrams_.emplace_back(datagram);
+      }
+    }
+
+    // receive storage is allocated on first use and reused by every batch
+    void _prepare_recv(size_t batch) {
+      if (recv_data_.empty()) {
+        recv_data_.resize(batch * datagram_size_);
+        recv_msgs_.resize(batch);
+        recv_iovs_.resize(batch);
+        recv_addrs_.resize(batch);
+        recv_controls_.resize(batch * control_size);
+      }
+
+      for (size_t i = 0; i < batch; i++) {
+        recv_iovs_[i].iov_base          = &recv_data_[i * datagram_size_];
+        recv_iovs_[i].iov_len           = datagram_size_;
+        msghdr& msg                     = recv_msgs_[i].msg_hdr;
+        msg                             = {};
+        msg.msg_name                    = &recv_addrs_[i];
+        msg.msg_namelen                 = sizeof(sockaddr_storage);
+        msg.msg_iov                     = &recv_iovs_[i];
+        msg.msg_iovlen                  = 1;
+        msg.msg_control                 = gro_ ? &recv_controls_[i * control_size] : nullptr;
+        msg.msg_controllen              = gro_ ? control_size : 0;
+        recv_msgs_[i].msg_len           = 0;
+      }
+    }
+
+    void _prepare_send(size_t index, size_t count) {
+      if (send_msgs_.size() < udp_batch_size) {
+        send_msgs_.resize(udp_batch_size);
+        send_iovs_.resize(udp_batch_size);
+        send_controls_.resize(udp_batch_size * control_size);
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        Outgoing& out               = outgoing_[index + i];
+        send_iovs_[i].iov_base      = &send_data_[out.offset];
+        send_iovs_[i].iov_len       = out.size;
+        msghdr& msg                 = send_msgs_[i].msg_hdr;
+        msg                         = {};
+        msg.msg_name                = &out.addr;
+        msg.msg_namelen             = out.addr_len;
+        msg.msg_iov                 = &send_iovs_[i];
+        msg.msg_iovlen              = 1;
+        send_msgs_[i].msg_len       = 0;
+        if (out.segment_size == 0) { continue; }
+
+        msg.msg_control             = &send_controls_[i * control_size];
+        msg.msg_controllen          = CMSG_SPACE(sizeof(uint16_t));
+        cmsghdr* cmsg               = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level            = SOL_UDP;
+        cmsg->cmsg_type             = UDP_SEGMENT;
+        cmsg->cmsg_len              = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &out.segment_size, sizeof(uint16_t));
+      }
+    }
+
+    void _release_handle() {
+      if (handle_ == invalid_socket) { return; }
+
+      ::close(handle_);
+      handle_ = invalid_socket;
+    }
+
+    void _queue_flush();
+    void _closed();
+    // stop the poller watching the socket, defined by the poller
+    void _unregister();
+  private:
+    socket_t                      handle_         = invalid_socket;
+    int                           epoll_fd_       = -1;
+    IPoller*                      poller_         = nullptr;
+    UdpSockets*                   owner_          = nullptr;
+    DatagramCallback              on_datagrams_   = nullptr;
+    bool                          closed_         = false;
+    bool                          flush_queued_   = false;
+    bool                          gro_            = false;
+    size_t                        datagram_size_  = udp_datagram_size;
+    uint64_t                      dropped_        = 0;
+    uint32_t                      ops_            = 0;    // in-flight io_uring polls
+
+    std::vector<char>             recv_data_;
+    std::vector<mmsghdr>          recv_msgs_;
+    std::vector<iovec>            recv_iovs_;
+    std::vector<sockaddr_storage> recv_addrs_;
+    std::vector<char>             recv_controls_;
+    std::vector<Datagram>         datagrams_;
+
+    std::vector<Outgoing>         outgoing_;
+    std::vector<char>             send_data_;
+    std::vector<mmsghdr>          send_msgs_;
+    std::vector<iovec>            send_iovs_;
+    std::vector<char>             send_controls_;
+  };
+
+  // The UDP sockets of one poller: queued sends are flushed once per poll iteration and closed
+  // sockets are released on cleanup, once the poller holds no in-flight operation on them.
+  class UdpSockets {
+  public:
+    UdpSockets() = default;
+    ~UdpSockets() { release(true); }
+
+    UdpSockets(const UdpSockets&) = delete;
+    UdpSockets& operator=(const UdpSockets&) = delete;
+
+    void add(UdpSocket* udp) {
+      udp->owner_ = this;
+      sockets_.emplace_back(udp);
+    }
+
+    void queue_flush(UdpSocket* udp) { flush_.emplace_back(udp); }
+
+    void flush() {
+      if (flush_.empty()) { return; }
+
+      pending_.swap(flush_);
+      for (UdpSocket* udp : pending_) {
+        udp->flush_queued_ = false;
+        if (udp->is_valid()) { udp->flush(); }
+      }
+      pending_.clear();
+    }
+
+    void close_all() {
+      for (size_t i = 0; i < sockets_.size(); i++) {
+        sockets_[i]->close();
+      }
+    }
+
+    // force ignores in-flight operations, for when nothing can complete anymore
+    void release(bool force = false) {
+      if (force) { close_all(); }
+      if (closed_.empty()) { return; }
+
+      pending_.swap(closed_);
+      for (UdpSocket* udp : pending_) {
+        if (!force && udp->ops_ > 0) {
+          closed_.emplace_back(udp);
+          continue;
+        }
+
+        sockets_.erase(std::find(sockets_.begin(), sockets_.end(), udp));
+        flush_.erase(std::remove(flush_.begin(), flush_.end(), udp), flush_.end());
+        delete udp;
+      }
+      pending_.clear();
+    }
+
+    void on_closed(UdpSocket* udp) { closed_.emplace_back(udp); }
+  private:
+    std::vector<UdpSocket*> sockets_;
+    std::vector<UdpSocket*> flush_;
+    std::vector<UdpSocket*> closed_;
+    std::vector<UdpSocket*> pending_;
+  };
+
+  inline void UdpSocket::_queue_flush() { owner_->queue_flush(this); }
+  inline void UdpSocket::_closed() { owner_->on_closed(this); }
+
+#ifndef COXNET_USE_IO_URING
+  // events still queued in the current batch are skipped through is_valid()
+  inline void UdpSocket::_unregister() { epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, handle_, nullptr); }
+#endif
+} // namespace coxnet
+
+#endif // __linux__
+
+#endif // UDP_SOCKET_H
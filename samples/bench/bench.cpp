@@ -0,0 +1,123 @@
+#include "coxnet/coxnet.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// 统计堆分配次数, 用于确认热路径上没有分配
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) { return ptr; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+static constexpr size_t kMessages      = 200000;
+static constexpr size_t kMessageSize   = 64;
+static constexpr size_t kDispatchCalls = 100000000;
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// 两端互相回显同一条消息, 每次回调即一条消息
+struct EchoHandler {
+    size_t received = 0;
+
+    void on_data(coxnet::Socket* conn, const char* data, size_t len) {
+        received++;
+        if (received < kMessages) { conn->write(data, len); }
+    }
+};
+
+struct Result {
+    double ns_per_message = 0;
+    size_t allocations    = 0;
+};
+
+template <typename PollerType, typename Counter>
+static Result run_echo(PollerType& poller, coxnet::Socket* client, Counter&& received) {
+    if (client == nullptr) { return {}; }
+
+    // 握手和首次读写的分配不计入
+    char message[kMessageSize] = {};
+    client->write(message, sizeof(message));
+    while (received() < 16) { poller.poll(-1); }
+
+    const size_t      allocations = g_allocations.load();
+    const size_t      start_count = received();
+    const auto        start       = Clock::now();
+    while (received() < kMessages) { poller.poll(-1); }
+
+    Result result;
+    result.ns_per_message = elapsed_ns(start) / static_cast<double>(received() - start_count);
+    result.allocations    = g_allocations.load() - allocations;
+    poller.shut();
+    return result;
+}
+
+// 只比较回调派发本身: std::function 与 BasicPoller 对 Handler 成员的直接调用
+struct CountingHandler {
+    volatile size_t calls = 0;  // 防止编译器把整个循环折叠掉
+
+    void on_data(coxnet::Socket*, const char*, size_t) { calls = calls + 1; }
+};
+
+static void bench_dispatch() {
+    CountingHandler handler;
+    coxnet::DataCallback callback = [&handler](coxnet::Socket* conn, const char* data, size_t len) {
+        handler.on_data(conn, data, len);
+    };
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < kDispatchCalls; i++) { callback(nullptr, nullptr, i); }
+    const double function_ns = elapsed_ns(start) / kDispatchCalls;
+
+    start = Clock::now();
+    for (size_t i = 0; i < kDispatchCalls; i++) { handler.on_data(nullptr, nullptr, i); }
+    const double direct_ns = elapsed_ns(start) / kDispatchCalls;
+
+    std::cout << "dispatch only:  std::function " << function_ns << " ns/call, direct handler call "
+              << direct_ns << " ns/call" << std::endl;
+}
+
+int main() {
+    coxnet::initialize_socket_env();
+
+    {
+        size_t          received = 0;
+        coxnet::Poller  poller;
+        auto on_data = [&received](coxnet::Socket* conn, const char* data, size_t len) {
+            received++;
+            if (received < kMessages) { conn->write(data, len); }
+        };
+        poller.listen("127.0.0.1", 9601, coxnet::ProtocolStack::kOnlyIPv4, nullptr, on_data, nullptr);
+        coxnet::Socket* client = poller.connect("127.0.0.1", 9601, on_data, nullptr);
+
+        Result result = run_echo(poller, client, [&received] { return received; });
+        std::cout << "std::function:  " << result.ns_per_message << " ns/message, "
+                  << result.allocations << " allocations" << std::endl;
+    }
+
+    {
+        coxnet::BasicPoller<EchoHandler> poller;
+        poller.listen("127.0.0.1", 9602, coxnet::ProtocolStack::kOnlyIPv4);
+        coxnet::Socket* client = poller.connect("127.0.0.1", 9602);
+
+        Result result = run_echo(poller, client, [&poller] { return poller.handler().received; });
+        std::cout << "BasicPoller:    " << result.ns_per_message << " ns/message, "
+                  << result.allocations << " allocations" << std::endl;
+    }
+
+    bench_dispatch();
+
+    coxnet::cleanup_socket_env();
+    return 0;
+}
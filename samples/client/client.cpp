@@ -24,10 +24,7 @@ int main() {
     client->write(test_msg, strlen(test_msg));
     
     // 事件循环
-    while(true) {
-        poller.poll();
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    poller.run();
     
     coxnet::cleanup_socket_env();
     return 0;
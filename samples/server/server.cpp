@@ -25,10 +25,7 @@ int main() {
     std::cout << "Server running on port 8080..." << std::endl;
     
     // 事件循环
-    while(true) {
-        poller.poll();
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    poller.run();
     
     coxnet::cleanup_socket_env();
     return 0;
@@ -0,0 +1,27 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// 失败时打印位置并以非0退出, ctest据此判定失败
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            std::exit(1);                                                             \
+        }                                                                             \
+    } while (0)
+
+// 轮流poll各个poller直到pred成立, 最多5秒, 返回pred的最终结果
+template <typename Pred, typename... Pollers>
+bool poll_until(Pred pred, Pollers&... pollers) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!pred() && std::chrono::steady_clock::now() < deadline) {
+        (pollers.poll(1), ...);
+    }
+    return pred();
+}
+
+#endif // TESTS_CHECK_H
@@ -0,0 +1,109 @@
+#include "coxnet/coxnet.h"
+#include "check.h"
+
+#include <string>
+#include <vector>
+
+using namespace coxnet;
+
+// 服务端按4字节大端长度分帧, 客户端逐段发送原始字节
+struct FramingPair {
+    Poller                   server;
+    Poller                   client;
+    Socket*                  conn       = nullptr;
+    std::vector<std::string> frames;
+    int                      close_err  = 0;
+
+    FramingPair(uint16_t port, FrameOptions options) {
+        LengthFieldCodec codec(options);
+        server.set_read_callback(codec.reader([this](Socket*, const char* data, size_t size) {
+            frames.emplace_back(data, size);
+        }));
+        CHECK(server.listen("127.0.0.1", port, ProtocolStack::kOnlyIPv4, nullptr, nullptr,
+                            [this](Socket*, int err) { close_err = err; }));
+        conn = client.connect("127.0.0.1", port, nullptr, nullptr);
+        CHECK(conn != nullptr);
+    }
+
+    ~FramingPair() {
+        client.shut();
+        server.shut();
+    }
+
+    void send(const std::string& bytes) {
+        conn->write(bytes.data(), bytes.size());
+        for (int i = 0; i < 20; i++) {
+            client.poll(1);
+            server.poll(1);
+        }
+    }
+};
+
+static std::string header(uint32_t size) {
+    const char bytes[4] = { static_cast<char>(size >> 24), static_cast<char>(size >> 16),
+                            static_cast<char>(size >> 8), static_cast<char>(size) };
+    return std::string(bytes, 4);
+}
+
+// 头部和负载被拆开到达时, 帧要等完整后才交付
+static void test_partial_header() {
+    FramingPair pair(9713, FrameOptions{});
+    std::string frame = header(5) + "hello";
+
+    pair.send(frame.substr(0, 2));
+    CHECK(pair.frames.empty());
+    pair.send(frame.substr(2, 4));
+    CHECK(pair.frames.empty());
+    pair.send(frame.substr(6) + header(0) + header(3) + "ab");
+    CHECK(pair.frames.size() == 2);
+    CHECK(pair.frames[0] == "hello" && pair.frames[1].empty());
+
+    pair.send("c");
+    CHECK(pair.frames.size() == 3 && pair.frames[2] == "abc");
+    CHECK(pair.close_err == 0);
+}
+
+// 正好max_frame_size的帧可以通过, 超出一个字节则以EMSGSIZE关闭
+static void test_max_frame_size() {
+    FramingPair pair(9714, FrameOptions{ 4, ByteOrder::kBigEndian, 16 });
+    pair.send(header(16) + std::string(16, 'x'));
+    CHECK(pair.frames.size() == 1 && pair.frames[0].size() == 16);
+
+    pair.send(header(17));
+    CHECK(poll_until([&] { return pair.close_err != 0; }, pair.server, pair.client));
+    CHECK(pair.close_err == EMSGSIZE);
+    CHECK(pair.frames.size() == 1);
+}
+
+// 长度超出头部宽度能表示的范围时write拒绝, 不发送任何数据
+static void test_header_width_overflow() {
+    LengthFieldCodec narrow(FrameOptions{ 1, ByteOrder::kBigEndian, 1024 });
+    CHECK(narrow.options().max_frame_size == 255);
+
+    LengthFieldCodec wide(FrameOptions{ 2, ByteOrder::kLittleEndian, 1 << 20 });
+    CHECK(wide.options().max_frame_size == 65535);
+
+    Poller  server;
+    Poller  client;
+    CHECK(server.listen("127.0.0.1", 9715, ProtocolStack::kOnlyIPv4, nullptr, nullptr, nullptr));
+    Socket* conn = client.connect("127.0.0.1", 9715, nullptr, nullptr);
+    CHECK(conn != nullptr);
+
+    std::string payload(300, 'y');
+    CHECK(narrow.write(conn, payload.data(), 255) > 0);
+    const size_t pending = conn->pending_write_bytes();
+    CHECK(narrow.write(conn, payload.data(), payload.size()) == -1);
+    CHECK(conn->pending_write_bytes() == pending);
+
+    client.shut();
+    server.shut();
+}
+
+int main() {
+    initialize_socket_env();
+    test_partial_header();
+    test_max_frame_size();
+    test_header_width_overflow();
+    cleanup_socket_env();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "coxnet/coxnet.h"
+#include "check.h"
+
+#include <string>
+#include <thread>
+
+using namespace coxnet;
+
+static Socket* fake_socket(uintptr_t value) { return reinterpret_cast<Socket*>(value); }
+
+// 同一个fd被复用时分配新的generation, 旧id不再命中
+static void test_generation_reuse() {
+    ConnTable table;
+    const ConnId first = table.insert(5, fake_socket(0x10));
+    CHECK(first != invalid_conn_id);
+    CHECK(table.find(first) == fake_socket(0x10));
+    CHECK(table.insert(5, fake_socket(0x20)) == invalid_conn_id);
+
+    CHECK(table.erase(5) == fake_socket(0x10));
+    CHECK(table.find(first) == nullptr);
+
+    const ConnId second = table.insert(5, fake_socket(0x20));
+    CHECK(second != invalid_conn_id);
+    CHECK(second != first);
+    CHECK(static_cast<uint32_t>(second) == static_cast<uint32_t>(first));
+    CHECK(table.find(first) == nullptr);
+    CHECK(table.find(second) == fake_socket(0x20));
+    CHECK(table.find(static_cast<socket_t>(5)) == fake_socket(0x20));
+}
+
+// 其他线程向已关闭连接的id写入: 请求被丢弃, 不会写到复用该fd的新连接上
+static void test_cross_thread_write_to_closed() {
+    Poller      server;
+    Poller      client;
+    Socket*     accepted    = nullptr;
+    std::string received;
+    bool ok = server.listen("127.0.0.1", 9710, ProtocolStack::kOnlyIPv4,
+                            [&](Socket* conn) { accepted = conn; }, nullptr, nullptr);
+    CHECK(ok);
+
+    // 第一个连接所在的poller关闭后, 服务端读到EOF并释放连接
+    {
+        Poller first;
+        CHECK(first.connect("127.0.0.1", 9710, nullptr, nullptr) != nullptr);
+        CHECK(poll_until([&] { return accepted != nullptr; }, server, first));
+        first.shut();
+    }
+
+    const ConnId stale = accepted->id();
+    accepted = nullptr;
+    CHECK(poll_until([&] { return server.find(stale) == nullptr; }, server));
+
+    // 新连接大概率复用同一个fd, 旧id必须仍然无效
+    Socket* second = client.connect("127.0.0.1", 9710, [&](Socket*, const char* data, size_t size) {
+        received.append(data, size);
+    }, nullptr);
+    CHECK(second != nullptr);
+    CHECK(poll_until([&] { return accepted != nullptr; }, server, client));
+    CHECK(server.find(stale) == nullptr);
+
+    std::thread([&] { server.write(stale, "stale", 5); }).join();
+    std::thread([&] { server.write(accepted->id(), "fresh", 5); }).join();
+    CHECK(poll_until([&] { return received.size() >= 5; }, server, client));
+    for (int i = 0; i < 20; i++) {
+        server.poll(1);
+        client.poll(1);
+    }
+    CHECK(received == "fresh");
+
+    // 在poller线程上对过期id的写入直接返回-1
+    CHECK(server.write(stale, "stale", 5) == -1);
+
+    client.shut();
+    server.shut();
+}
+
+int main() {
+    initialize_socket_env();
+    test_generation_reuse();
+    test_cross_thread_write_to_closed();
+    cleanup_socket_env();
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "coxnet/timer_wheel.h"
+#include "check.h"
+
+#include <vector>
+
+using coxnet::TimerNode;
+using coxnet::TimerWheel;
+
+struct Timer : TimerNode {
+    TimerWheel*           wheel = nullptr;
+    std::vector<uint64_t> fired;
+
+    explicit Timer(TimerWheel* owner) : wheel(owner) {
+        on_expire_ = [](TimerNode* node) {
+            auto timer = static_cast<Timer*>(node);
+            timer->fired.emplace_back(timer->wheel->current());
+        };
+    }
+};
+
+// 按1ms逐步推进, 模拟poll循环
+static void step_to(TimerWheel& wheel, uint64_t until) {
+    for (uint64_t now = wheel.current() + 1; now <= until; now++) {
+        wheel.advance(now);
+    }
+}
+
+// 高层级的定时器逐级下放后准时触发, 且只触发一次
+static void test_cascade() {
+    TimerWheel     wheel;
+    const uint64_t start  = wheel.current();
+    Timer          near(&wheel);
+    Timer          level1(&wheel);
+    Timer          level2(&wheel);
+    wheel.add(&near, start + 10);
+    wheel.add(&level1, start + 300);
+    wheel.add(&level2, start + 20000);
+
+    CHECK(wheel.next_timeout(start) == 10);
+
+    step_to(wheel, start + 299);
+    CHECK(near.fired.size() == 1 && near.fired[0] == start + 10);
+    CHECK(level1.fired.empty());
+
+    step_to(wheel, start + 300);
+    CHECK(level1.fired.size() == 1 && level1.fired[0] == start + 300);
+
+    // 一次大跨度推进, 中途经过的级联都要处理
+    wheel.advance(start + 19999);
+    CHECK(level2.fired.empty());
+    CHECK(!wheel.empty());
+    wheel.advance(start + 30000);
+    CHECK(level2.fired.size() == 1 && level2.fired[0] == start + 20000);
+    CHECK(wheel.empty());
+    CHECK(wheel.next_timeout(wheel.current()) == -1);
+}
+
+// 取消后不再触发, 在级联之前和之后取消都一样
+static void test_cancel() {
+    TimerWheel     wheel;
+    const uint64_t start  = wheel.current();
+    Timer          early(&wheel);
+    Timer          late(&wheel);
+    Timer          kept(&wheel);
+    wheel.add(&early, start + 50);
+    wheel.add(&late, start + 5000);
+    wheel.add(&kept, start + 5000);
+
+    wheel.cancel(&early);
+    CHECK(!early.pending());
+
+    // 推进到经过级联之后再取消
+    step_to(wheel, start + 4500);
+    wheel.cancel(&late);
+    CHECK(!late.pending());
+
+    step_to(wheel, start + 6000);
+    CHECK(early.fired.empty());
+    CHECK(late.fired.empty());
+    CHECK(kept.fired.size() == 1 && kept.fired[0] == start + 5000);
+    CHECK(wheel.empty());
+
+    // 重新add会先取消旧的到期时间
+    wheel.add(&kept, wheel.current() + 100);
+    wheel.add(&kept, wheel.current() + 20);
+    const uint64_t due = wheel.current() + 20;
+    step_to(wheel, wheel.current() + 200);
+    CHECK(kept.fired.size() == 2 && kept.fired[1] == due);
+}
+
+int main() {
+    test_cascade();
+    test_cancel();
+    return 0;
+}
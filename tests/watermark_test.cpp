@@ -0,0 +1,62 @@
+#include "coxnet/coxnet.h"
+#include "check.h"
+
+#include <string>
+
+using namespace coxnet;
+
+// 对端暂停读取时写入越过高水位通知一次, 恢复读取后降到低水位再通知一次
+static void test_pause_resume() {
+    Poller  server;
+    Poller  client;
+    Socket* accepted  = nullptr;
+    size_t  received  = 0;
+    int     highs     = 0;
+    int     lows      = 0;
+    CHECK(server.listen("127.0.0.1", 9720, ProtocolStack::kOnlyIPv4,
+                        [&](Socket* conn) {
+                          accepted = conn;
+                          conn->pause_reading();
+                        },
+                        [&](Socket*, const char*, size_t size) { received += size; }, nullptr));
+
+    client.set_watermark_callbacks([&](Socket*, size_t) { highs++; }, [&](Socket*, size_t) { lows++; });
+    Socket* conn = client.connect("127.0.0.1", 9720, nullptr, nullptr);
+    CHECK(conn != nullptr);
+    conn->set_write_watermarks(256 * 1024, 64 * 1024);
+    CHECK(poll_until([&] { return accepted != nullptr; }, server, client));
+
+    // 写到内核缓冲区也装不下, 待发送数据越过高水位
+    const std::string chunk(64 * 1024, 'z');
+    size_t            sent = 0;
+    while (conn->pending_write_bytes() < 512 * 1024 && sent < 64 * 1024 * 1024) {
+        conn->write(chunk.data(), chunk.size());
+        sent += chunk.size();
+        client.poll(0);
+        server.poll(0);
+    }
+    CHECK(highs == 1);
+    CHECK(lows == 0);
+    CHECK(received == 0);
+
+    // 再写也不会重复通知
+    conn->write(chunk.data(), chunk.size());
+    sent += chunk.size();
+    CHECK(highs == 1);
+
+    accepted->resume_reading();
+    CHECK(poll_until([&] { return received == sent; }, server, client));
+    CHECK(highs == 1);
+    CHECK(lows == 1);
+    CHECK(conn->pending_write_bytes() == 0);
+
+    client.shut();
+    server.shut();
+}
+
+int main() {
+    initialize_socket_env();
+    test_pause_resume();
+    cleanup_socket_env();
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "coxnet/coxnet.h"
+#include "check.h"
+
+#include <algorithm>
+#include <string>
+
+using coxnet::IoVec;
+using coxnet::WriteChain;
+
+static std::string gather(const IoVec* vecs, size_t count) {
+    std::string out;
+    for (size_t i = 0; i < count; i++) {
+        out.append(static_cast<const char*>(vecs[i].iov_base), vecs[i].iov_len);
+    }
+    return out;
+}
+
+static const std::string data = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+// 每次写入不超过一个chunk, 写满后另起一个chunk
+static void write_in_pieces(WriteChain& chain) {
+    for (size_t offset = 0; offset < data.size(); offset += 10) {
+        chain.write(data.data() + offset, std::min<size_t>(10, data.size() - offset));
+    }
+}
+
+// 跨chunk写入后, fill得到的iovec按顺序拼出原始数据
+static void test_write_spans_chunks() {
+    WriteChain chain(16);
+    write_in_pieces(chain);
+    CHECK(chain.size() == data.size());
+    CHECK(chain.segment_count() == 3);
+
+    IoVec vecs[8];
+    size_t count = chain.fill(vecs, 8);
+    CHECK(count == 3);
+    CHECK(gather(vecs, count) == data);
+
+    // max限制只填前面的段
+    CHECK(chain.fill(vecs, 2) == 2);
+    CHECK(gather(vecs, 2) == data.substr(0, 32));
+}
+
+// 一次大块写入只占一个加大的chunk
+static void test_large_write() {
+    WriteChain chain(16);
+    chain.write(data.data(), data.size());
+    CHECK(chain.segment_count() == 1);
+
+    IoVec vecs[8];
+    CHECK(chain.fill(vecs, 8) == 1);
+    CHECK(gather(vecs, 1) == data);
+}
+
+// 部分consume落在段中间时, 剩余数据从段内偏移处继续
+static void test_partial_consume() {
+    WriteChain chain(16);
+    write_in_pieces(chain);
+
+    chain.consume(5);
+    CHECK(chain.size() == data.size() - 5);
+    CHECK(chain.segment_count() == 3);
+
+    IoVec vecs[8];
+    size_t count = chain.fill(vecs, 8);
+    CHECK(vecs[0].iov_len == 11);
+    CHECK(gather(vecs, count) == data.substr(5));
+
+    // 正好消费完第一个段, 段被释放
+    chain.consume(11);
+    CHECK(chain.segment_count() == 2);
+    count = chain.fill(vecs, 8);
+    CHECK(gather(vecs, count) == data.substr(16));
+
+    // 跨段消费
+    chain.consume(18);
+    CHECK(chain.size() == 2);
+    CHECK(chain.segment_count() == 1);
+    count = chain.fill(vecs, 8);
+    CHECK(gather(vecs, count) == "yz");
+
+    chain.consume(2);
+    CHECK(chain.empty());
+    CHECK(chain.fill(vecs, 8) == 0);
+}
+
+// consume之后追加的数据接在剩余数据后面
+static void test_write_after_consume() {
+    WriteChain chain(16);
+    chain.write("hello ", 6);
+    chain.consume(3);
+    chain.write("world", 5);
+
+    IoVec  vecs[8];
+    size_t count = chain.fill(vecs, 8);
+    CHECK(gather(vecs, count) == "lo world");
+    CHECK(chain.size() == 8);
+}
+
+int main() {
+    test_write_spans_chunks();
+    test_large_write();
+    test_partial_consume();
+    test_write_after_consume();
+    return 0;
+}